@@ -0,0 +1,544 @@
+#include "filecache.h"
+
+using namespace std;
+
+//文件类型：文件类型描述
+const unordered_map<string, string> FileCache::SUFFIX_TYPE = {
+    { ".html",  "text/html" },
+    { ".xml",   "text/xml" },
+    { ".xhtml", "application/xhtml+xml" },
+    { ".txt",   "text/plain" },
+    { ".rtf",   "application/rtf" },
+    { ".pdf",   "application/pdf" },
+    { ".word",  "application/nsword" },
+    { ".png",   "image/png" },
+    { ".gif",   "image/gif" },
+    { ".jpg",   "image/jpeg" },
+    { ".jpeg",  "image/jpeg" },
+    { ".au",    "audio/basic" },
+    { ".mpeg",  "video/mpeg" },
+    { ".mpg",   "video/mpeg" },
+    { ".avi",   "video/x-msvideo" },
+    { ".gz",    "application/x-gzip" },
+    { ".tar",   "application/x-tar" },
+    { ".css",   "text/css "},
+    { ".js",    "text/javascript "},
+};
+
+//目录中文件的增删改、属性变化，以及目录自身被删除或移走
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+FileCache::Entry::Entry(): mode(0), size(0), data(nullptr), fd(-1), mtime(), ino(0), checked(0) {
+    for(auto& response: responses) {
+        response.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+FileCache::Entry::~Entry() {
+    for(auto& response: responses) {
+        delete response.load(std::memory_order_relaxed);
+    }
+    if(data) {
+        munmap(data, size);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+}
+
+const string* FileCache::Entry::SetResponse(int slot, string&& response) const {
+    const string* created = new string(std::move(response));
+    const string* expected = nullptr;
+    if(!responses[slot].compare_exchange_strong(expected, created, std::memory_order_acq_rel)) {
+        delete created;
+        return expected;
+    }
+    return created;
+}
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+FileCache::FileCache(): bytes_(0), maxEntries_(DEFAULT_MAX_ENTRIES), maxBytes_(DEFAULT_MAX_BYTES),
+                        sendfileThreshold_(DEFAULT_SENDFILE_THRESHOLD), version_(0) {
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd_ = eventfd(0, EFD_CLOEXEC);
+    if(inotifyFd_ < 0 || stopFd_ < 0) {
+        //没有inotify时退回按时间重新检查
+        if(inotifyFd_ >= 0) { close(inotifyFd_); }
+        if(stopFd_ >= 0) { close(stopFd_); }
+        inotifyFd_ = stopFd_ = -1;
+    }
+}
+
+FileCache::~FileCache() {
+    if(watchThread_) {
+        uint64_t one = 1;
+        ssize_t ret = write(stopFd_, &one, sizeof(one));
+        (void)ret;
+        watchThread_->join();
+    }
+    Clear();
+    if(inotifyFd_ >= 0) { close(inotifyFd_); }
+    if(stopFd_ >= 0) { close(stopFd_); }
+}
+
+FileCache::EntryPtr FileCache::Get(const string& srcDir, const string& path) {
+    string normalized;
+    bool changed = false;
+    if(!Normalize_(path, normalized, &changed)) {
+        return nullptr;
+    }
+    const string& key = changed ? normalized : path;
+
+    //命中时锁内只有一次查找和LRU调整
+    Root* root = nullptr;
+    EntryPtr stale; //需要重新检查的条目（没有inotify时）
+    unique_lock<mutex> locker(mtx_);
+    root = FindRoot_(srcDir);
+    if(!root) {
+        return nullptr;
+    }
+    auto found = root->nodes.find(key);
+    if(found != root->nodes.end()) {
+        NodeIter node = found->second;
+        if(root->watched || NowMs_() - node->entry->checked < REVALIDATE_MS) {
+            lru_.splice(lru_.begin(), lru_, node);
+            return node->entry;
+        }
+        stale = node->entry;
+    }
+
+    //未命中或需要重新检查：在锁外调用fstatat或打开和映射文件，不挡住其他线程的查找
+    for(int attempt = 0; ; attempt++) {
+        shared_ptr<DirFd> dirFd = root->dirFd;
+        size_t threshold = sendfileThreshold_;
+        uint64_t version = version_, rootVersion = root->version;
+        locker.unlock();
+        EntryPtr entry;
+        bool unchanged = stale && Unchanged_(dirFd->fd, key, *stale);
+        if(!unchanged) {
+            entry = Load_(root, dirFd->fd, key, threshold);
+        }
+        locker.lock();
+
+        found = root->nodes.find(key);
+        NodeIter node = found != root->nodes.end() ? found->second : lru_.end();
+        //别的线程已经先放入了新的条目，用它的
+        if(node != lru_.end() && node->entry != stale) {
+            lru_.splice(lru_.begin(), lru_, node);
+            return node->entry;
+        }
+        if(unchanged) {
+            if(node != lru_.end()) {
+                const_cast<Entry&>(*stale).checked = NowMs_();
+                lru_.splice(lru_.begin(), lru_, node);
+            }
+            return stale;
+        }
+        if(node != lru_.end()) {
+            Erase_(node);
+        }
+        stale = nullptr;
+        if(!entry || (version == version_ && rootVersion == root->version)) {
+            if(entry) {
+                Insert_(root, key, entry);
+            }
+            return entry;
+        }
+        //加载期间有文件失效或缓存被清空，加载的可能是旧内容或按旧的阈值打开的
+        //多半是加载之前就已排队的inotify事件，重新加载一次；再有变化时照常使用但不缓存
+        if(attempt > 0 || !root->dirFd) {
+            return entry;
+        }
+    }
+}
+
+void FileCache::SetLimit(size_t maxEntries, size_t maxBytes) {
+    lock_guard<mutex> locker(mtx_);
+    maxEntries_ = max<size_t>(maxEntries, 1);
+    maxBytes_ = maxBytes;
+    EvictIfNeeded_();
+}
+
+void FileCache::SetSendfileThreshold(size_t threshold) {
+    lock_guard<mutex> locker(mtx_);
+    sendfileThreshold_ = threshold;
+    version_++;
+    while(!lru_.empty()) {
+        Erase_(lru_.begin());
+    }
+}
+
+void FileCache::Clear() {
+    lock_guard<mutex> locker(mtx_);
+    version_++;
+    while(!lru_.empty()) {
+        Erase_(lru_.begin());
+    }
+}
+
+size_t FileCache::Count() {
+    lock_guard<mutex> locker(mtx_);
+    return lru_.size();
+}
+
+size_t FileCache::Bytes() {
+    lock_guard<mutex> locker(mtx_);
+    return bytes_;
+}
+
+bool FileCache::IsWatched(const string& srcDir) {
+    lock_guard<mutex> locker(mtx_);
+    Root* root = FindRoot_(srcDir);
+    return root && root->watched;
+}
+
+const string& FileCache::MimeType(const string& path) {
+    static const string plain = "text/plain";
+    //获取后缀，例如.html .jpg
+    string::size_type idx = path.find_last_of('.');
+    if(idx == string::npos) {
+        return plain;
+    }
+    auto it = SUFFIX_TYPE.find(path.substr(idx));
+    return it == SUFFIX_TYPE.end() ? plain : it->second;
+}
+
+//第一次访问某个资源目录时打开它并开始监视；目录被删除后再访问时重新打开
+FileCache::Root* FileCache::FindRoot_(const string& srcDir) {
+    Root* root = nullptr;
+    for(auto& r: roots_) {
+        if(r->dir == srcDir) {
+            root = r.get();
+            break;
+        }
+    }
+    if(root && root->dirFd) {
+        return root;
+    }
+    int dirFd = open(srcDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) {
+        LOG_ERROR("open resource dir %s error: %d", srcDir.c_str(), errno);
+        return nullptr;
+    }
+    if(!root) {
+        roots_.emplace_back(new Root);
+        root = roots_.back().get();
+        root->dir = srcDir;
+    }
+    root->dirFd = make_shared<DirFd>(dirFd);
+    root->watched = inotifyFd_ >= 0;
+    if(root->watched) {
+        WatchDir_(root, "");
+        if(!watchThread_) {
+            watchThread_.reset(new thread(&FileCache::WatchLoop_, this));
+        }
+    }
+    LOG_INFO("file cache: %s, %s", srcDir.c_str(), root->watched ? "inotify" : "revalidate");
+    return root;
+}
+
+//inotify不会递归，每个子目录单独监视；rel为相对资源目录的路径，以/开头，资源目录自身为空
+void FileCache::WatchDir_(Root* root, const string& rel) {
+    string path = rel.empty() ? root->dir : root->dir + rel.substr(1);
+    int wd = inotify_add_watch(inotifyFd_, path.c_str(), WATCH_MASK);
+    if(wd < 0) {
+        //监视数量达到上限等，该资源目录改为按时间重新检查
+        LOG_WARN("inotify watch %s error: %d", path.c_str(), errno);
+        root->watched = false;
+        return;
+    }
+    bool found = false;
+    for(auto range = watches_.equal_range(wd); range.first != range.second; ++range.first) {
+        if(range.first->second.first == root) {
+            range.first->second.second = rel;
+            found = true;
+        }
+    }
+    if(!found) {
+        watches_.insert({ wd, { root, rel } });
+    }
+    int fd = openat(root->dirFd->fd, rel.empty() ? "." : rel.c_str() + 1, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = fd < 0 ? nullptr : fdopendir(fd);
+    if(!dir) {
+        if(fd >= 0) { close(fd); }
+        return;
+    }
+    while(struct dirent* ent = readdir(dir)) {
+        if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        bool isDir = ent->d_type == DT_DIR;
+        if(ent->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        if(isDir) {
+            WatchDir_(root, rel + "/" + ent->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+//没有inotify时：文件没有变化则继续使用缓存的条目
+bool FileCache::Unchanged_(int dirFd, const string& key, const Entry& entry) {
+    struct stat st;
+    return fstatat(dirFd, key.size() > 1 ? key.c_str() + 1 : ".", &st, 0) == 0 &&
+           st.st_ino == entry.ino && st.st_mode == entry.mode &&
+           st.st_mtim.tv_sec == entry.mtime.tv_sec && st.st_mtim.tv_nsec == entry.mtime.tv_nsec &&
+           (entry.size == 0 || static_cast<size_t>(st.st_size) == entry.size);
+}
+
+//打开文件并映射到内存；没有读权限时只记录mode，由调用者返回403
+//root只用来取目录名（创建后不变），文件相对dirFd打开
+FileCache::EntryPtr FileCache::Load_(const Root* root, int dirFd, const string& key, size_t sendfileThreshold) {
+    const char* rel = key.size() > 1 ? key.c_str() + 1 : ".";
+    struct stat st;
+    //O_NONBLOCK：打开管道等特殊文件时不会阻塞
+    int fd = openat(dirFd, rel, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0) {
+        if(fstatat(dirFd, rel, &st, 0) < 0) {
+            return nullptr;
+        }
+    }
+    else if(fstat(fd, &st) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    shared_ptr<Entry> entry = make_shared<Entry>();
+    entry->mode = st.st_mode;
+    entry->mtime = st.st_mtim;
+    entry->ino = st.st_ino;
+    entry->type = MimeType(key);
+    entry->checked = NowMs_();
+    if(S_ISREG(st.st_mode)) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", static_cast<unsigned long>(st.st_ino),
+                 static_cast<unsigned long>(st.st_size),
+                 static_cast<unsigned long>(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000);
+        entry->etag = buf;
+        struct tm tm;
+        gmtime_r(&st.st_mtim.tv_sec, &tm);
+        strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        entry->lastModified = buf;
+    }
+    if(fd >= 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IROTH) && static_cast<size_t>(st.st_size) > sendfileThreshold) {
+        //大文件：映射整个文件会在发送时引起大量缺页，保留文件描述符交给sendfile
+        entry->fd = fd;
+        entry->size = st.st_size;
+        fd = -1;
+    }
+    else if(fd >= 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IROTH) && st.st_size > 0) {
+        /* 使用mmap将文件映射到内存，提高文件的访问速度
+            MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
+        void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        entry->data = static_cast<char*>(data);
+        entry->size = st.st_size;
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    LOG_DEBUG("file cache load %s%s, size %zu", root->dir.c_str(), rel, entry->size);
+    return entry;
+}
+
+//映射的大文件不占用缓存，由调用者用完后释放；sendfile的文件只占一个文件描述符，照常缓存
+void FileCache::Insert_(Root* root, const string& key, const EntryPtr& entry) {
+    size_t mapped = entry->data ? entry->size : 0;
+    if(mapped > maxBytes_ / 4) {
+        return;
+    }
+    lru_.push_front(Node{ root, key, entry });
+    root->nodes[key] = lru_.begin();
+    bytes_ += mapped;
+    EvictIfNeeded_();
+}
+
+void FileCache::Erase_(NodeIter it) {
+    bytes_ -= it->entry->data ? it->entry->size : 0;
+    it->root->nodes.erase(it->key);
+    lru_.erase(it);
+}
+
+void FileCache::EvictIfNeeded_() {
+    while(!lru_.empty() && (lru_.size() > maxEntries_ || bytes_ > maxBytes_)) {
+        Erase_(prev(lru_.end()));
+    }
+}
+
+//key本身，以及key是目录时其中的所有文件
+void FileCache::InvalidatePrefix_(Root* root, const string& key) {
+    root->version++;
+    vector<NodeIter> stale;
+    for(auto& item: root->nodes) {
+        const string& k = item.first;
+        if(k.compare(0, key.size(), key) == 0 && (k.size() == key.size() || k[key.size()] == '/')) {
+            stale.push_back(item.second);
+        }
+    }
+    for(NodeIter it: stale) {
+        Erase_(it);
+    }
+}
+
+//资源目录本身被删除或移走
+void FileCache::DropRoot_(Root* root) {
+    InvalidatePrefix_(root, "");
+    for(auto it = watches_.begin(); it != watches_.end(); ) {
+        if(it->second.first == root) {
+            it = Unwatch_(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    root->dirFd.reset();
+    root->watched = false;
+}
+
+FileCache::WatchMap::iterator FileCache::Unwatch_(WatchMap::iterator it) {
+    int wd = it->first;
+    it = watches_.erase(it);
+    if(watches_.count(wd) == 0) {
+        inotify_rm_watch(inotifyFd_, wd);
+    }
+    return it;
+}
+
+void FileCache::WatchLoop_() {
+    //inotify_event按自身对齐，一次读出多个事件
+    alignas(struct inotify_event) char buf[16384];
+    struct pollfd fds[2] = { { inotifyFd_, POLLIN, 0 }, { stopFd_, POLLIN, 0 } };
+    while(true) {
+        if(poll(fds, 2, -1) < 0) {
+            if(errno == EINTR) { continue; }
+            return;
+        }
+        if(fds[1].revents) {
+            return;
+        }
+        ssize_t len;
+        while((len = read(inotifyFd_, buf, sizeof(buf))) > 0) {
+            lock_guard<mutex> locker(mtx_);
+            for(char* p = buf; p < buf + len; ) {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                HandleEvent_(event);
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+void FileCache::HandleEvent_(const struct inotify_event* event) {
+    if(event->mask & IN_Q_OVERFLOW) {
+        //事件丢失，不知道哪些文件变了，全部失效
+        version_++;
+        while(!lru_.empty()) {
+            Erase_(lru_.begin());
+        }
+        return;
+    }
+    if(event->mask & IN_IGNORED) {
+        watches_.erase(event->wd);
+        return;
+    }
+    //处理时可能增删监视，先复制出来
+    vector<pair<Root*, string>> targets;
+    for(auto range = watches_.equal_range(event->wd); range.first != range.second; ++range.first) {
+        targets.push_back(range.first->second);
+    }
+    for(auto& target: targets) {
+        HandleWatchEvent_(target.first, target.second, event);
+    }
+}
+
+void FileCache::HandleWatchEvent_(Root* root, const string& rel, const struct inotify_event* event) {
+    if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if(rel.empty()) {
+            DropRoot_(root);
+        }
+        else {
+            InvalidatePrefix_(root, rel);
+        }
+        return;
+    }
+    if(event->len == 0) {
+        return;
+    }
+    string key = rel + "/" + event->name;
+    InvalidatePrefix_(root, key);
+    if(!(event->mask & IN_ISDIR)) {
+        return;
+    }
+    //子目录移走后，原来的监视描述符对应的路径已经不对了
+    if(event->mask & IN_MOVED_FROM) {
+        for(auto it = watches_.begin(); it != watches_.end(); ) {
+            const string& r = it->second.second;
+            if(it->second.first == root && r.compare(0, key.size(), key) == 0 &&
+               (r.size() == key.size() || r[key.size()] == '/')) {
+                it = Unwatch_(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    //新的子目录：开始监视，监视之前可能已经有文件被缓存，再失效一次
+    if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        WatchDir_(root, key);
+        InvalidatePrefix_(root, key);
+    }
+}
+
+bool FileCache::Normalize_(const string& path, string& out, bool* changed) {
+    *changed = false;
+    if(path.empty() || path[0] != '/') {
+        return false;
+    }
+    //先检查一遍，大多数路径已经是规范形式
+    size_t n = path.size();
+    for(size_t i = 0; i < n; i++) {
+        if(path[i] != '/') {
+            continue;
+        }
+        size_t next = path.find('/', i + 1);
+        size_t len = (next == string::npos ? n : next) - i - 1;
+        if(len == 2 && path[i + 1] == '.' && path[i + 2] == '.') {
+            return false;
+        }
+        if((len == 0 && i + 1 < n) || (len == 1 && path[i + 1] == '.')) {
+            *changed = true;
+        }
+    }
+    if(!*changed) {
+        return true;
+    }
+    out.clear();
+    for(size_t i = 0; i < n; ) {
+        size_t next = path.find('/', i + 1);
+        if(next == string::npos) { next = n; }
+        size_t len = next - i - 1;
+        if(len > 0 && !(len == 1 && path[i + 1] == '.')) {
+            out.append(path, i, next - i);
+        }
+        i = next;
+    }
+    if(out.empty() || path.back() == '/') {
+        out += '/';
+    }
+    return true;
+}
+
+uint64_t FileCache::NowMs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
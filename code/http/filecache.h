@@ -0,0 +1,151 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <fcntl.h>       // openat
+#include <unistd.h>      // close
+#include <poll.h>
+#include <dirent.h>      // fdopendir
+#include <sys/stat.h>    // fstatat
+#include <sys/mman.h>    // mmap, munmap
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <string>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include "../log/log.h"
+
+//静态资源的打开文件缓存，单例模式
+//按路径缓存文件的内存映射、大小、修改时间和MIME类型，命中时不需要任何文件系统调用
+//超过sendfile阈值的大文件不映射，只保留打开的文件描述符，由发送方用sendfile分块发送
+//路径相对资源目录的文件描述符用openat解析；条目数和映射的总字节数有上限，超出时淘汰最久没用的
+//资源目录用inotify监视，文件改动后立即失效；inotify不可用时每隔REVALIDATE_MS重新fstatat一次
+//锁内只做查找和LRU调整；未命中时在锁外打开和映射文件，期间有文件失效则重新加载一次，仍有变化时结果不放入缓存
+class FileCache {
+public:
+    //一个文件：不是可读的普通文件（目录、没有读权限）时只记录mode，size为0
+    //条目用shared_ptr交给发送队列，被淘汰或失效后，等最后一个使用者发送完才解除映射
+    struct Entry {
+        static const int RESPONSE_SLOTS = 10;
+
+        mode_t mode;
+        size_t size;
+        char* data;            //内存映射，size为0或者是大文件时为nullptr
+        int fd;                //大文件打开的文件描述符，用于sendfile；其他文件为-1
+        struct timespec mtime;
+        ino_t ino;
+        std::string type;      //MIME类型
+        std::string etag;      //普通文件的强校验值，由inode、大小和修改时间组成，带引号
+        std::string lastModified; //普通文件的修改时间，HTTP日期格式
+        uint64_t checked;      //上次确认没有变化的时间（毫秒），只在没有inotify时使用
+
+        //序列化好的完整响应（响应头加文件内容），槽位的含义由使用者决定，第一次用到时生成
+        //文件改动后整个条目失效，缓存的响应随之释放
+        mutable std::atomic<const std::string*> responses[RESPONSE_SLOTS];
+
+        Entry();
+        ~Entry();
+        const std::string* Response(int slot) const { return responses[slot].load(std::memory_order_acquire); }
+        //保存生成的响应；别的线程已经先保存过时丢弃这一份。返回槽位中的响应
+        const std::string* SetResponse(int slot, std::string&& response) const;
+    };
+    typedef std::shared_ptr<const Entry> EntryPtr;
+
+    static const size_t DEFAULT_MAX_ENTRIES = 1024;
+    static const size_t DEFAULT_MAX_BYTES = 64 << 20;
+    static const int REVALIDATE_MS = 1000;
+    static const size_t DEFAULT_SENDFILE_THRESHOLD = 1 << 20;
+
+    static FileCache* Instance();
+
+    //srcDir为资源目录（以/结尾），path为请求的路径（以/开头）
+    //文件不存在、路径含有..或映射失败时返回nullptr
+    EntryPtr Get(const std::string& srcDir, const std::string& path);
+
+    //超过maxBytes / 4的文件不缓存，每次使用时单独映射；maxBytes只计算映射的字节数
+    void SetLimit(size_t maxEntries, size_t maxBytes);
+    //超过threshold的文件改用sendfile发送，已经缓存的条目全部失效
+    void SetSendfileThreshold(size_t threshold);
+    void Clear();
+
+    size_t Count();
+    size_t Bytes();
+    bool IsWatched(const std::string& srcDir); //该资源目录是否由inotify监视
+
+    //根据后缀返回MIME类型，如.html为text/html，未知时为text/plain
+    static const std::string& MimeType(const std::string& path);
+
+private:
+    FileCache();
+    ~FileCache();
+
+    struct Root;
+    struct Node {
+        Root* root;
+        std::string key;
+        EntryPtr entry;
+    };
+    typedef std::list<Node>::iterator NodeIter;
+
+    //资源目录的文件描述符：锁外打开文件时各持有一份，资源目录被移走后等最后一个使用者用完再关闭
+    struct DirFd {
+        int fd;
+        explicit DirFd(int dirFd): fd(dirFd) {}
+        ~DirFd() { close(fd); }
+    };
+
+    //一个资源目录，通常整个进程只有一个；创建后不会删除，锁外可以持有指针
+    struct Root {
+        std::string dir;
+        std::shared_ptr<DirFd> dirFd; //资源目录被移走后为空，下次访问时重新打开
+        bool watched = false;
+        uint64_t version = 0; //该目录下有条目失效时加一
+        std::unordered_map<std::string, NodeIter> nodes; //键为规范化后的路径
+    };
+
+    //监视描述符 -> (资源目录, 相对路径)；资源目录互相嵌套时同一个目录得到同一个监视描述符，各自记一份
+    typedef std::unordered_multimap<int, std::pair<Root*, std::string>> WatchMap;
+
+    Root* FindRoot_(const std::string& srcDir);
+    void WatchDir_(Root* root, const std::string& rel);
+    //在锁外调用
+    static EntryPtr Load_(const Root* root, int dirFd, const std::string& key, size_t sendfileThreshold);
+    static bool Unchanged_(int dirFd, const std::string& key, const Entry& entry);
+    void Insert_(Root* root, const std::string& key, const EntryPtr& entry);
+    void Erase_(NodeIter it);
+    void EvictIfNeeded_();
+    void InvalidatePrefix_(Root* root, const std::string& key);
+    void DropRoot_(Root* root);
+    WatchMap::iterator Unwatch_(WatchMap::iterator it); //没有别的资源目录在用时才移除监视
+    void WatchLoop_();
+    void HandleEvent_(const struct inotify_event* event);
+    void HandleWatchEvent_(Root* root, const std::string& rel, const struct inotify_event* event);
+
+    //合并//、去掉/./，含有..时返回false；已经是规范形式时不复制
+    static bool Normalize_(const std::string& path, std::string& out, bool* changed);
+    static uint64_t NowMs_();
+
+    std::mutex mtx_;
+    std::list<Node> lru_; //最近使用的在前
+    std::vector<std::unique_ptr<Root>> roots_;
+    size_t bytes_;
+    size_t maxEntries_;
+    size_t maxBytes_;
+    size_t sendfileThreshold_;
+    uint64_t version_; //清空缓存时加一；与Root::version一起，锁外加载前后有变化则不放入缓存
+
+    int inotifyFd_;
+    int stopFd_;   //eventfd，析构时唤醒监视线程
+    WatchMap watches_;
+    std::unique_ptr<std::thread> watchThread_;
+
+    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
+};
+
+#endif //FILE_CACHE_H
@@ -4,11 +4,19 @@ using namespace std;
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
+HttpConn::UploadHandler HttpConn::uploadHandler;
 
 HttpConn::HttpConn() { 
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    parsed_ = false;
+    errorCode_ = 400;
+    keepAlive_ = true;
+    lastActive_ = 0;
+    tasks_ = 0;
+    outHead_ = 0;
+    toWrite_ = 0;
 };
 
 HttpConn::~HttpConn() { 
@@ -22,18 +30,28 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     fd_ = fd;
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    request_.Init();
+    ClearOutput_();
+    keepAlive_ = true;
+    if(async_) {
+        async_->Reset();
+    }
     isClose_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
-//关闭连接
+//关闭连接，重复调用时什么也不做
 //close会触发EPOLLIN和EPOLLRDHUP
-void HttpConn::Close() {
-    response_.UnmapFile();
+void HttpConn::Close(bool closeFd) {
     if(isClose_ == false){
+        response_.UnmapFile();
+        ClearOutput_();
+        request_.Init(); //删除上传的临时文件
         isClose_ = true; 
         userCount--;//连接数减1
-        close(fd_);
+        if(closeFd) {
+            close(fd_);
+        }
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
     }
 }
@@ -56,76 +74,240 @@ int HttpConn::GetPort() const {
 
 ssize_t HttpConn::read(int* saveErrno) {
     ssize_t len = -1;
+    size_t total = 0;
     do{
         len = readBuff_.ReadFd(fd_, saveErrno);//把数据读到readbuff中
         if (len <= 0) {
             break;
         }
-    } while (isET); //et模式，一次性读出来
+        total += len;
+    } while (isET && total < READ_BUDGET); //et模式，读到没有数据或读够READ_BUDGET，不让请求体堆积在读缓冲区
     return len;
 }
 
+//发送队列开头是大文件时用sendfile分块发送，否则把直到下一个大文件之前的响应头和文件组装成iovec，一次writev尽量多发
 ssize_t HttpConn::write(int* saveErrno) {
     ssize_t len = -1;
+    int sendfiles = 0;
     do {
-        //writev分散写，分散内存块，分散内存块数量
-        len = writev(fd_, iov_, iovCnt_);
-        if(len <= 0) {
-            *saveErrno = errno;
-            break;
-        }
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { 
+        if(outHead_ == out_.size()) {
             break; // 传输结束 
-        } 
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
+        }
+        if(out_[outHead_].IsSendfile()) {
+            //大文件发送太久会占住工作线程，按EAGAIN返回，等EPOLLOUT时接着发送
+            if(sendfiles++ == SENDFILE_BUDGET) {
+                *saveErrno = EAGAIN;
+                return -1;
             }
+            len = Sendfile_(saveErrno);
         }
         else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuff_.Retrieve(len);
+            len = Writev_(saveErrno);
         }
+        if(len <= 0) {
+            break;
+        }
+        Advance_(len);
     } while(isET || ToWriteBytes() > 10240);//et模式，一次性写
     return len;
 }
 
-bool HttpConn::process() {
-    //根据读缓冲区内容，初始化request对象
-    request_.Init();
+size_t HttpConn::BuildIov_(struct iovec* iov, int* cnt, size_t* len) const {
+    *cnt = 0;
+    *len = 0;
+    size_t i = outHead_;
+    const char* buff = writeBuff_.Peek();
+    for(; i < out_.size() && *cnt < MAX_IOV && !out_[i].IsSendfile(); i++, (*cnt)++) {
+        if(out_[i].data) {
+            iov[*cnt].iov_base = const_cast<char*>(out_[i].data);
+        }
+        else {
+            iov[*cnt].iov_base = const_cast<char*>(buff);
+            buff += out_[i].len;
+        }
+        iov[*cnt].iov_len = out_[i].len;
+        *len += out_[i].len;
+    }
+    return i;
+}
+
+ssize_t HttpConn::Writev_(int* saveErrno) {
+    struct iovec iov[MAX_IOV];
+    int cnt = 0;
+    size_t total = 0;
+    size_t i = BuildIov_(iov, &cnt, &total);
+    //后面紧跟着sendfile的文件时用MSG_MORE，响应头和文件开头合并成满的TCP报文
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = cnt;
+    ssize_t len = sendmsg(fd_, &msg, i < out_.size() ? MSG_MORE : 0);
+    if(len <= 0) {
+        *saveErrno = errno;
+    }
+    return len;
+}
+
+const struct msghdr* HttpConn::PrepareSend(int* flags, size_t* len) {
+    if(outHead_ == out_.size() || out_[outHead_].IsSendfile()) {
+        return nullptr;
+    }
+    AsyncState& st = Async();
+    int cnt = 0;
+    size_t i = BuildIov_(st.iov, &cnt, len);
+    st.msg = {};
+    st.msg.msg_iov = st.iov;
+    st.msg.msg_iovlen = cnt;
+    *flags = i < out_.size() ? MSG_MORE : 0;
+    return &st.msg;
+}
+
+//文件在发送过程中被截断时sendfile返回0，按出错处理，关闭连接
+ssize_t HttpConn::Sendfile_(int* saveErrno) {
+    Segment& seg = out_[outHead_];
+    off_t off = seg.off;
+    ssize_t len = sendfile(fd_, seg.file->fd, &off, std::min(seg.len, SENDFILE_CHUNK));
+    if(len < 0) {
+        *saveErrno = errno;
+    }
+    else if(len == 0) {
+        *saveErrno = EIO;
+        len = -1;
+    }
+    return len;
+}
+
+void HttpConn::Advance_(size_t len) {
+    assert(len <= toWrite_);
+    toWrite_ -= len;
+    while(len > 0) {
+        Segment& seg = out_[outHead_];
+        size_t n = std::min(len, seg.len);
+        if(seg.data) {
+            seg.data += n;
+        }
+        else if(seg.file) {
+            seg.off += n;
+        }
+        else {
+            writeBuff_.Retrieve(n);
+        }
+        seg.len -= n;
+        len -= n;
+        if(seg.len == 0) {
+            seg.file.reset();
+            outHead_++;
+        }
+    }
+    if(outHead_ == out_.size()) {
+        out_.clear(); //保留容量
+        outHead_ = 0;
+    }
+}
+
+//写缓冲区中新追加的len字节，和前一块相邻时直接合并
+void HttpConn::PushBuffer_(size_t len) {
+    if(len == 0) {
+        return;
+    }
+    if(out_.size() > outHead_ && !out_.back().data && !out_.back().file) {
+        out_.back().len += len;
+    }
+    else {
+        out_.push_back(Segment{ nullptr, nullptr, len, 0 });
+    }
+    toWrite_ += len;
+}
+
+void HttpConn::PushFile_(const FileCache::EntryPtr& file, size_t off, size_t len) {
+    if(file->data) {
+        out_.push_back(Segment{ file, file->data + off, len, 0 });
+    }
+    else {
+        out_.push_back(Segment{ file, nullptr, len, static_cast<off_t>(off) });
+    }
+    toWrite_ += len;
+}
+
+void HttpConn::ClearOutput_() {
+    out_.clear(); //释放还没发送的文件
+    outHead_ = 0;
+    toWrite_ = 0;
+}
+
+bool HttpConn::parse() {
     //判断可读数据大小，没有可读数据返回false
     if(readBuff_.ReadableBytes() <= 0) {
         return false;
     }
-    //解析请求内容，初始化response
-    else if(request_.parse(readBuff_)) {
+    //上一个请求的响应已经生成，有了新数据才开始解析新的请求（上一个请求的临时文件在这时删除）
+    //未完成的请求保留解析状态，接着解析新读入的数据
+    if(request_.IsFinished()) {
+        request_.Init();
+    }
+    //解析请求内容，数据还不完整时等待下一次读
+    HttpRequest::HTTP_CODE ret = request_.parse(readBuff_);
+    if(ret == HttpRequest::NO_REQUEST) {
+        return false;
+    }
+    parsed_ = (ret == HttpRequest::GET_REQUEST);
+    if(!parsed_) {
+        errorCode_ = ret == HttpRequest::ENTITY_TOO_LARGE ? 413 : 400;
+        readBuff_.RetrieveAll(); //格式错误，丢弃剩余数据，返回400后关闭连接
+    }
+    return true;
+}
+
+void HttpConn::MakeResponse() {
+    if(parsed_) {
+        if(uploadHandler && !request_.files().empty()) {
+            uploadHandler(request_, request_.TakeFiles());
+        }
+        //登录注册，查询数据库
+        request_.Verify();
         LOG_DEBUG("%s", request_.path().c_str());
         //初始化响应报文对象
         response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        std::string_view range = request_.GetHeader(HttpRequest::RANGE);
+        if(!range.empty() && request_.method() == "GET") {
+            response_.SetRange(range, request_.GetHeader("If-Range"));
+        }
     } 
     else {
-        response_.Init(srcDir, request_.path(), false, 400);
+        response_.Init(srcDir, request_.path(), false, errorCode_);
     }
 
-    //生成相应对象response，把响应信息放入写缓冲区
+    //生成相应对象response，把响应信息追加到写缓冲区，排在前面还没发送的响应之后
+    size_t before = writeBuff_.ReadableBytes();
     response_.MakeResponse(writeBuff_);
+    keepAlive_ = response_.IsKeepAlive();
     
     //分散写，多块缓冲区的内容都要写
     /* 响应头 */
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
+    PushBuffer_(writeBuff_.ReadableBytes() - before);
 
-    /* 文件 */
-    if(response_.FileLen() > 0  && response_.File()) {
-        iov_[1].iov_base = response_.File();//返回内存映射的指针
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;
+    /* 文件或缓存的完整响应，文件缓存的条目交给发送队列，发送完后释放 */
+    const char* file = response_.File();
+    size_t len = response_.FileLen();
+    if(len > 0 && file) {
+        out_.push_back(Segment{ response_.ReleaseFile(), file, len, 0 });
+        toWrite_ += len;
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
-    return true;
-}
+    /* 大文件，用sendfile从文件描述符直接发送 */
+    else if(len > 0 && response_.FileFd() >= 0) {
+        size_t off = response_.FileOffset();
+        out_.push_back(Segment{ response_.ReleaseFile(), nullptr, len, static_cast<off_t>(off) });
+        toWrite_ += len;
+    }
+    /* 多个范围：分隔符和每一段的头部在写缓冲区，文件内容只发送请求的部分 */
+    else if(!response_.Parts().empty()) {
+        FileCache::EntryPtr entry = response_.ReleaseFile();
+        for(const HttpResponse::FilePart& part: response_.Parts()) {
+            writeBuff_.Append(part.head);
+            PushBuffer_(part.head.size());
+            PushFile_(entry, part.off, part.len);
+        }
+        writeBuff_.Append(response_.PartsTail());
+        PushBuffer_(response_.PartsTail().size());
+    }
+    LOG_DEBUG("filesize:%zu, %zu  to %zu", len, out_.size() - outHead_, ToWriteBytes());
+}
\ No newline at end of file
@@ -3,9 +3,14 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
+#include <sys/socket.h>  // sendmsg
+#include <sys/sendfile.h>
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <vector>
+#include <memory>
+#include <functional>
 
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
@@ -25,7 +30,8 @@ public:
 
     ssize_t write(int* saveErrno);
 
-    void Close();
+    //closeFd为false时fd已经（或将要）由事件后端关闭，这里只释放连接的资源
+    void Close(bool closeFd = true);
 
     int GetFd() const;
 
@@ -35,18 +41,88 @@ public:
     
     sockaddr_in GetAddr() const;
     
-    bool process();
+    static const int MAX_IOV = 64; //一次writev最多发送的块数
+    static constexpr size_t SENDFILE_CHUNK = 512 << 10; //每次sendfile最多发送的字节数
+    static const int SENDFILE_BUDGET = 8; //一次write最多调用sendfile的次数，用完后让出线程，等EPOLLOUT再继续
+    //ET模式下一次read最多读入的字节数（超过时读完当前这次readv为止），读够后先解析，请求体边读边取走
+    //剩下的数据在重新注册EPOLLIN时由epoll_ctl发现仍然可读，再次通知
+    static const size_t READ_BUDGET = 64 << 10;
+
+    //处理请求分为两步：parse解析请求，MakeResponse生成响应
+    //两步之间可以用NeedSql判断请求是否要查询数据库，把会阻塞的MakeResponse交给别的线程
+    //流水线：读缓冲区中可能有多个完整的请求，MakeResponse把响应追加到发送队列，之后一起发送
+    bool parse();
+
+    bool NeedSql() const {
+        return request_.NeedVerify();
+    }
+
+    void MakeResponse();
 
-    int ToWriteBytes() { 
-        return iov_[0].iov_len + iov_[1].iov_len; 
+    size_t ToWriteBytes() const { 
+        return toWrite_; 
     }
 
+    //发送队列中最后一个响应是否保持连接
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return keepAlive_;
+    }
+
+    //还能继续解析下一个请求并把响应排进发送队列：连接保持，并且一次writev能发完
+    bool CanPipeline() const {
+        return keepAlive_ && out_.size() - outHead_ + 2 <= MAX_IOV;
+    }
+
+    //最后一次读写事件的时间，只由事件循环线程读写
+    void Touch(uint64_t now) { lastActive_ = now; }
+    uint64_t LastActive() const { return lastActive_; }
+
+    //完成模式（io_uring）：读写由事件后端完成，连接只负责缓冲区
+    //Received把后端收到的数据追加到读缓冲区；PrepareSend把发送队列开头直到下一个大文件之前的块组装成msghdr，
+    //*len为其中的字节数，*flags为发送标志，开头是用sendfile发送的大文件或没有要发送的数据时返回nullptr；
+    //返回的msghdr在Sent（发送完成）之前保持有效，Sent按发送了的字节数移动发送队列
+    void Received(const char* data, size_t len) { readBuff_.Append(data, len); }
+    bool HasInput() const { return readBuff_.ReadableBytes() > 0; }
+    const struct msghdr* PrepareSend(int* flags, size_t* len);
+    void Sent(size_t len) { Advance_(len); }
+
+    //完成模式下连接的状态，只由事件循环线程读写；第一次使用时分配，epoll模式不占用内存
+    struct AsyncState {
+        bool busy = false;        //请求交给了线程池，还没有交回事件循环
+        bool sending = false;     //Send还没有完成
+        bool blocked = false;     //大文件发送缓冲区满，等待可写
+        bool closing = false;     //要关闭，等上面的操作结束后再关闭
+        bool closeLinked = false; //最后一次Send之后由事件后端关闭fd
+        bool paused = false;      //暂停了接收
+        Buffer inbox;             //处理请求或发送期间收到的数据，处理完再交给读缓冲区
+        struct iovec iov[MAX_IOV];
+        struct msghdr msg;
+
+        void Reset() {
+            busy = sending = blocked = closing = closeLinked = paused = false;
+            inbox.RetrieveAll();
+        }
+    };
+    AsyncState& Async() {
+        if(!async_) {
+            async_.reset(new AsyncState());
+        }
+        return *async_;
     }
 
+    //正在使用该连接的任务数：任务交给线程池之前Hold，任务结束（已经重新注册事件或关闭连接）后Release
+    //不为0时连接不算空闲，超时也不能关闭；计数不随连接重置，旧任务晚一点Release也不会出错
+    void Hold() { tasks_.fetch_add(1, std::memory_order_relaxed); }
+    void Release() { tasks_.fetch_sub(1, std::memory_order_release); }
+    bool InFlight() const { return tasks_.load(std::memory_order_acquire) > 0; }
+
+    //multipart上传的处理函数：请求解析完、生成响应之前在同一个线程中调用，临时文件交给它移走或删除
+    //没有设置时，临时文件在下一个请求开始或连接关闭时删除
+    typedef std::function<void(const HttpRequest& request, std::vector<HttpRequest::UploadFile>&& files)> UploadHandler;
+
     static bool isET;
     static const char* srcDir;  // 资源目录
+    static UploadHandler uploadHandler;
     static std::atomic<int> userCount;  //总共连接的客户端的数量
     
 private:
@@ -55,15 +131,43 @@ private:
     struct  sockaddr_in addr_;
 
     bool isClose_;
-    
-    int iovCnt_;
-    struct iovec iov_[2];
+    bool parsed_; //parse是否成功，失败时MakeResponse返回errorCode_
+    int errorCode_; //400，或请求体过大时413
+    bool keepAlive_;
+    uint64_t lastActive_;
+    std::atomic<int> tasks_;
+
+    //发送队列中的一块：写缓冲区中的响应头，文件缓存中的文件（或缓存的完整响应），或者用sendfile发送的大文件
+    //写缓冲区中的块按顺序连续存放，发送了多少就从写缓冲区取走多少，所以只需记录长度
+    struct Segment {
+        FileCache::EntryPtr file; //保证data有效的文件缓存条目，发送完后释放；预先生成的错误页面为空
+        const char* data;         //还没发送的内容，nullptr且file为空表示写缓冲区中的一段
+        size_t len;               //还没发送的长度
+        off_t off;                //sendfile的块：文件中下一个要发送的位置
+
+        bool IsSendfile() const { return !data && file; }
+    };
+
+    size_t BuildIov_(struct iovec* iov, int* cnt, size_t* len) const; //返回下一个没有放进iov的块
+    ssize_t Writev_(int* saveErrno);
+    ssize_t Sendfile_(int* saveErrno);
+
+    void PushBuffer_(size_t len);
+    void PushFile_(const FileCache::EntryPtr& file, size_t off, size_t len); //文件中的一段，映射的从内存发送，否则用sendfile
+    void Advance_(size_t len); //writev发送了len字节，移动发送队列
+    void ClearOutput_();
+
+    std::vector<Segment> out_;
+    size_t outHead_;  //第一个没有发送完的块
+    size_t toWrite_;
     
     Buffer readBuff_; // 读（请求）缓冲区，保存请求数据的内容
     Buffer writeBuff_; // 写（响应）缓冲区，保存响应数据的内容
 
     HttpRequest request_;
     HttpResponse response_;
+
+    std::unique_ptr<AsyncState> async_;
 };
 
 
@@ -5,70 +5,154 @@ const unordered_set<string> HttpRequest::DEFAULT_HTML{
             "/index", "/register", "/login",
              "/welcome", "/video", "/picture", };
 
+size_t HttpRequest::maxBodySize = HttpRequest::DEFAULT_MAX_BODY;
+size_t HttpRequest::maxUploadSize = HttpRequest::DEFAULT_MAX_UPLOAD;
+std::string HttpRequest::uploadDir = "/tmp";
+HttpRequest::UploadCallback HttpRequest::uploadCallback;
+
 const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
             {"/register.html", 0}, {"/login.html", 1},  };
+
+//与KNOWN_HEADER的顺序一致
+const char* const HttpRequest::KNOWN_HEADER_NAMES[KNOWN_HEADER_COUNT] = {
+            "connection", "content-length", "content-type", "host",
+            "range", "accept-encoding", "if-none-match", };
             
+//ASCII不区分大小写比较
+static bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    if(a.size() != b.size()) {
+        return false;
+    }
+    for(size_t i = 0; i < a.size(); i++) {
+        unsigned char x = a[i], y = b[i];
+        if(x != y && ((x | 0x20) != (y | 0x20) || (x | 0x20) < 'a' || (x | 0x20) > 'z')) {
+            return false;
+        }
+    }
+    return true;
+}
+
 //初始化
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
+    path_ = body_ = "";
+    method_ = version_ = Span();
+    base_ = "";
+    pos_ = scanned_ = 0;
     state_ = REQUEST_LINE; //首先解析首行
-    header_.clear();//map集合清空
+    verifyTag_ = -1;
+    headerCount_ = 0;
+    moreHeaders_.clear();//保留容量
+    knownMask_ = 0;
+    keepAlive_ = false;
+    contentLength_ = 0;
+    chunked_ = false;
+    chunkState_ = CHUNK_SIZE;
+    bodyLeft_ = bodySize_ = 0;
+    head_.clear();
     post_.clear();
+    RemoveUploads_();
+    multipart_.reset();
+    inFile_ = false;
 }
 
-bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+
+//常用头部的名字长度各不相同，按长度就能确定是哪一个，再比较一次
+int HttpRequest::KnownHeader_(std::string_view name) {
+    int idx;
+    switch(name.size()) {
+    case 4:  idx = HOST; break;
+    case 5:  idx = RANGE; break;
+    case 10: idx = CONNECTION; break;
+    case 12: idx = CONTENT_TYPE; break;
+    case 13: idx = IF_NONE_MATCH; break;
+    case 14: idx = CONTENT_LENGTH; break;
+    case 15: idx = ACCEPT_ENCODING; break;
+    default: return -1;
     }
-    return false;
+    return EqualsIgnoreCase(name, KNOWN_HEADER_NAMES[idx]) ? idx : -1;
 }
 
-//解析的主体函数
-bool HttpRequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";//换行位置
-    if(buff.ReadableBytes() <= 0) {
-        return false;
+std::string_view HttpRequest::GetHeader(std::string_view name) const {
+    int known = KnownHeader_(name);
+    if(known >= 0) {
+        return GetHeader(static_cast<KNOWN_HEADER>(known));
+    }
+    for(size_t i = 0; i < headerCount_; i++) {
+        const Header& header = i < INLINE_HEADERS ? headers_[i] : moreHeaders_[i - INLINE_HEADERS];
+        if(EqualsIgnoreCase(View_(header.name), name)) {
+            return View_(header.value);
+        }
     }
-    while(buff.ReadableBytes() && state_ != FINISH) {
-        //查找换行符，返回换行符的起始位置
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        //去除换行符的请求数据，string对象初始化为[begin,end)之间的字符
-        std::string line(buff.Peek(), lineEnd);
+    return std::string_view();
+}
 
-        //简单的有限状态机，解析请求行、首部、主体的状态迁移
+//解析的主体函数，直接在读缓冲区的内存上逐行解析，不复制每一行
+//可以跨多次读取续接：数据不完整时返回NO_REQUEST，已解析的状态保留到下次调用
+//请求行和头部完整之前不消耗缓冲区中的数据；请求体按收到的部分逐步解码并取走
+//请求完整时返回GET_REQUEST，并从缓冲区取走这个请求；格式错误返回BAD_REQUEST
+HttpRequest::HTTP_CODE HttpRequest::parse(Buffer& buff) {
+    if(state_ == BODY) {
+        return ParseBody_(buff);
+    }
+    //缓冲区扩容或整理后内存可能移动，但请求始终从读指针开始，偏移量仍然有效
+    base_ = buff.Peek();
+    const char* end = buff.BeginWriteConst();
+    //简单的有限状态机，解析请求行、首部的状态迁移
+    while(state_ != FINISH) {
+        const char* p = base_ + pos_;
+        //查找换行符，返回换行符的起始位置；从上次没找到的位置继续找，避免慢速客户端导致重复扫描
+        const char* lineEnd = HttpScan::FindCRLF(base_ + std::max(pos_, scanned_), end);
+        if(lineEnd == end) {
+            //\r可能是最后一个字节，下次从它开始找
+            scanned_ = std::max(pos_, static_cast<size_t>(end - base_) - (end > base_ && end[-1] == '\r' ? 1 : 0));
+            if(scanned_ > MAX_HEAD_SIZE) {
+                LOG_ERROR("Request head too large");
+                return BAD_REQUEST;
+            }
+            return NO_REQUEST;
+        }
+        pos_ = lineEnd + 2 - base_;
+        scanned_ = pos_;
         switch(state_){
-        //解析请求行
+        //解析请求行，请求行之前的空行忽略
         case REQUEST_LINE:
-            if(!ParseRequestLine_(line)) {
-                return false;
+            if(p == lineEnd) {
+                break;
+            }
+            if(!ParseRequestLine_(p, lineEnd)) {
+                return BAD_REQUEST;
             }
             //解析请求资源路径
             ParsePath_();
             break;    
-        //解析头部
+        //解析头部，空行表示头部结束
         case HEADERS:
-            ParseHeader_(line);
-            //可读字节数小于等于2，表明已经结束
-            if(buff.ReadableBytes() <= 2) {
-                state_ = FINISH;
+            if(p == lineEnd) {
+                HTTP_CODE ret = ParseHeadersDone_();
+                if(ret != NO_REQUEST) {
+                    return ret;
+                }
+                if(state_ == BODY) {
+                    //请求体可能比读缓冲区大：把头部复制出来，取走，之后收到的请求体解码后即可取走
+                    head_.assign(base_, pos_);
+                    base_ = head_.data();
+                    buff.Retrieve(pos_);
+                    return ParseBody_(buff);
+                }
+            }
+            else if(!ParseHeader_(p, lineEnd)) {
+                return BAD_REQUEST;
             }
-            break;
-        //解析体
-        case BODY:
-            ParseBody_(line);
             break;
         default:
             break;
         }
-        //当读指针到达写位置，没有可读数据，已经解析完成
-        if(lineEnd == buff.BeginWrite()){ 
-            break; 
-        }
-        //解析完一行，移动读指针readpos
-        buff.RetrieveUntil(lineEnd + 2);
     }
-    LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
+    //取走整个请求；视图指向的内存在下一次读入数据之前不会改变
+    buff.Retrieve(pos_);
+    LOG_DEBUG("[%.*s], [%s], [%.*s]", static_cast<int>(method_.len), base_ + method_.off, path_.c_str(),
+              static_cast<int>(version_.len), base_ + version_.off);
+    return GET_REQUEST;
 }
 
 //解析路径
@@ -89,118 +173,372 @@ void HttpRequest::ParsePath_() {
 }
 
 //解析请求行：请求方法、要访问的资源、使用的HTTP版本
-bool HttpRequest::ParseRequestLine_(const string& line){
-    //GET / HTTP/1.1
-    //正则表达式
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)){//匹配的数据放submatch   
-        method_ = subMatch[1]; //得到请求方法
-        path_ = subMatch[2]; //得到url字段，即请求资源
-        version_ = subMatch[3];  //得到http协议版本
-        state_ = HEADERS; //解析完请求行后，状态变为解析头部
-        return true;
+//GET / HTTP/1.1
+bool HttpRequest::ParseRequestLine_(const char* begin, const char* end){
+    //请求方法：token字符，以空格结束
+    const char* p = HttpScan::SkipToken(begin, end);
+    if(p == begin || p == end || *p != ' ') {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    method_ = Span_(begin, p);
+    //url字段：到下一个空格为止，不能有控制字符
+    const char* target = ++p;
+    p = HttpScan::FindSpaceOrCtl(p, end);
+    if(p == target || p == end || *p != ' ') {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    path_.assign(target, p);
+    //协议版本：HTTP/数字.数字
+    p++;
+    if(end - p != 8 || memcmp(p, "HTTP/", 5) != 0 || !isdigit(p[5]) || p[6] != '.' || !isdigit(p[7])) {
+        LOG_ERROR("RequestLine Error");
+        return false;
     }
-    LOG_ERROR("RequestLine Error");
-    return false;
+    version_ = Span_(p + 5, end);
+    state_ = HEADERS; //解析完请求行后，状态变为解析头部
+    return true;
 }
 
 //解析头部
-//Host：api.github.com
-//Connection：keep-alive
-void HttpRequest::ParseHeader_(const string& line) {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2]; //把请求头部的头部字段作为键，值作为值放进map，用于响应的时候重写？
+//Host: api.github.com
+//Connection: keep-alive
+bool HttpRequest::ParseHeader_(const char* begin, const char* end) {
+    const char* p = HttpScan::SkipToken(begin, end);
+    if(p == begin || p == end || *p != ':') {
+        LOG_ERROR("Header Error");
+        return false;
+    }
+    const char* nameEnd = p++;
+    //去掉值前后的空白
+    while(p < end && (*p == ' ' || *p == '\t')) { p++; }
+    const char* valueEnd = end;
+    while(valueEnd > p && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) { valueEnd--; }
+    Header header{ Span_(begin, nameEnd), Span_(p, valueEnd) };
+    if(headerCount_ < INLINE_HEADERS) {
+        headers_[headerCount_] = header;
     }
     else {
-        state_ = BODY;//解析完头部后，状态变为解析体
+        moreHeaders_.push_back(header);
     }
+    headerCount_++;
+    int known = KnownHeader_(std::string_view(begin, nameEnd - begin));
+    if(known >= 0 && !((knownMask_ >> known) & 1)) {
+        known_[known] = header.value;
+        knownMask_ |= 1u << known;
+    }
+    return true;
 }
 
-//解析请求体，如果是post，要解析，get不用解析请求体
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;
-    ParsePost_();
+//没有请求体时状态变为FINISH，有请求体时变为BODY，返回NO_REQUEST；请求体的长度或编码不合法时返回错误
+HttpRequest::HTTP_CODE HttpRequest::ParseHeadersDone_() {
+    keepAlive_ = EqualsIgnoreCase(GetHeader(CONNECTION), "keep-alive") && version() == "1.1";
+    std::string_view encoding = GetHeader("Transfer-Encoding");
+    std::string_view length = GetHeader(CONTENT_LENGTH);
+    contentLength_ = 0;
+    if(!encoding.empty()) {
+        //只支持chunked；同时带Content-Length的请求可能被用来做请求走私，直接拒绝
+        if(!EqualsIgnoreCase(encoding, "chunked") || !length.empty()) {
+            LOG_ERROR("Transfer-Encoding Error");
+            return BAD_REQUEST;
+        }
+        chunked_ = true;
+        chunkState_ = CHUNK_SIZE;
+        state_ = BODY;
+        return InitMultipart_();
+    }
+    for(char ch: length) {
+        //超过19位会溢出，肯定也超过了上限
+        if(!isdigit(static_cast<unsigned char>(ch)) || length.size() > 19) {
+            LOG_ERROR("Content-Length Error");
+            return BAD_REQUEST;
+        }
+        contentLength_ = contentLength_ * 10 + (ch - '0');
+    }
+    bodyLeft_ = contentLength_;
+    if(contentLength_ == 0) {
+        state_ = FINISH;
+        return NO_REQUEST;
+    }
+    state_ = BODY;
+    HTTP_CODE ret = InitMultipart_();
+    //是否为multipart决定了上限，确定之后、读入请求体之前检查
+    if(ret == NO_REQUEST && contentLength_ > BodyLimit_()) {
+        LOG_WARN("Body too large: %zu", contentLength_);
+        return ENTITY_TOO_LARGE;
+    }
+    return ret;
+}
+
+//multipart/form-data的请求体交给流式解析器，不保存在body_中
+HttpRequest::HTTP_CODE HttpRequest::InitMultipart_() {
+    std::string_view type = GetHeader(CONTENT_TYPE);
+    const std::string_view prefix = "multipart/form-data";
+    if(type.size() < prefix.size() || !EqualsIgnoreCase(type.substr(0, prefix.size()), prefix)) {
+        return NO_REQUEST;
+    }
+    std::string boundary = MultipartParser::Param(type, "boundary");
+    if(boundary.empty() || boundary.size() > 70) {
+        LOG_ERROR("Multipart boundary Error");
+        return BAD_REQUEST;
+    }
+    using namespace std::placeholders;
+    multipart_.reset(new MultipartParser(boundary, std::bind(&HttpRequest::OnPartBegin_, this, _1),
+                                         std::bind(&HttpRequest::OnPartData_, this, _1, _2),
+                                         std::bind(&HttpRequest::OnPartEnd_, this)));
+    return NO_REQUEST;
+}
+
+//请求体按Content-Length或分块编码确定结束位置，收到多少解码多少
+HttpRequest::HTTP_CODE HttpRequest::ParseBody_(Buffer& buff) {
+    if(chunked_) {
+        HTTP_CODE ret = ParseChunked_(buff);
+        if(ret != GET_REQUEST) {
+            return ret;
+        }
+    }
+    else {
+        size_t n = std::min(bodyLeft_, buff.ReadableBytes());
+        if(!OnBodyData_(buff.Peek(), n)) {
+            return BAD_REQUEST;
+        }
+        buff.Retrieve(n);
+        bodyLeft_ -= n;
+        if(bodyLeft_ > 0) {
+            return NO_REQUEST; //请求体还没收完
+        }
+    }
+    if(multipart_ && !multipart_->IsDone()) {
+        LOG_ERROR("Multipart body truncated");
+        return BAD_REQUEST;
+    }
     state_ = FINISH;
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    ParsePost_();
+    LOG_DEBUG("[%.*s], [%s], [%.*s] body len:%zu", static_cast<int>(method_.len), base_ + method_.off, path_.c_str(),
+              static_cast<int>(version_.len), base_ + version_.off, bodySize_);
+    return GET_REQUEST;
+}
+
+//分块编码：每块是"十六进制长度[;扩展]\r\n数据\r\n"，长度为0的块之后是可选的尾部字段和一个空行
+HttpRequest::HTTP_CODE HttpRequest::ParseChunked_(Buffer& buff) {
+    while(true) {
+        const char* p = buff.Peek();
+        const char* end = buff.BeginWriteConst();
+        if(chunkState_ == CHUNK_DATA) {
+            size_t n = std::min(bodyLeft_, buff.ReadableBytes());
+            if(!OnBodyData_(p, n)) {
+                return BAD_REQUEST;
+            }
+            buff.Retrieve(n);
+            bodyLeft_ -= n;
+            if(bodyLeft_ > 0) {
+                return NO_REQUEST;
+            }
+            chunkState_ = CHUNK_DATA_END;
+            continue;
+        }
+        if(chunkState_ == CHUNK_DATA_END) {
+            if(end - p < 2) {
+                return NO_REQUEST;
+            }
+            if(p[0] != '\r' || p[1] != '\n') {
+                LOG_ERROR("Chunk Error");
+                return BAD_REQUEST;
+            }
+            buff.Retrieve(2);
+            chunkState_ = CHUNK_SIZE;
+            continue;
+        }
+        //长度行和尾部字段都按行处理
+        const char* lineEnd = HttpScan::FindCRLF(p, end);
+        if(lineEnd == end) {
+            if(end - p > static_cast<ptrdiff_t>(MAX_HEAD_SIZE)) {
+                LOG_ERROR("Chunk line too long");
+                return BAD_REQUEST;
+            }
+            return NO_REQUEST;
+        }
+        if(chunkState_ == CHUNK_TRAILER) {
+            buff.RetrieveUntil(lineEnd + 2);
+            if(p == lineEnd) {
+                return GET_REQUEST;
+            }
+            continue;
+        }
+        //CHUNK_SIZE
+        size_t size = 0;
+        const char* q = p;
+        for(; q < lineEnd && isxdigit(static_cast<unsigned char>(*q)); q++) {
+            if(size > (BodyLimit_() >> 4)) {
+                LOG_WARN("Body too large");
+                return ENTITY_TOO_LARGE;
+            }
+            size = size * 16 + (isdigit(static_cast<unsigned char>(*q)) ? *q - '0' : (*q | 0x20) - 'a' + 10);
+        }
+        if(q == p || (q < lineEnd && *q != ';' && *q != ' ' && *q != '\t')) {
+            LOG_ERROR("Chunk Error");
+            return BAD_REQUEST;
+        }
+        //在读入这一块之前检查总长度
+        if(size > BodyLimit_() - bodySize_) {
+            LOG_WARN("Body too large: %zu", bodySize_ + size);
+            return ENTITY_TOO_LARGE;
+        }
+        buff.RetrieveUntil(lineEnd + 2);
+        bodyLeft_ = size;
+        chunkState_ = size > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+    }
 }
 
+bool HttpRequest::OnBodyData_(const char* data, size_t len) {
+    bodySize_ += len;
+    if(multipart_) {
+        return multipart_->Feed(data, len); //普通字段会追加到body_
+    }
+    body_.append(data, len);
+    return true;
+}
 
-int HttpRequest::ConverHex(char ch) {
-    if(ch >= 'A' && ch <= 'F') return ch -'A' + 10;
-    if(ch >= 'a' && ch <= 'f') return ch -'a' + 10;
-    return ch;
+bool HttpRequest::OnPartBegin_(const MultipartParser::Part& part) {
+    inFile_ = !part.filename.empty();
+    if(!inFile_) {
+        //字段名和值都追加到body_中，post_记录它们的位置
+        field_.keyOff = body_.size();
+        field_.keyLen = part.name.size();
+        body_ += part.name;
+        field_.valueOff = body_.size();
+        field_.valueLen = 0;
+        return true;
+    }
+    UploadFile file;
+    file.name = part.name;
+    file.filename = part.filename;
+    file.contentType = part.contentType;
+    if(!uploadCallback) {
+        std::string path = uploadDir + "/upload_XXXXXX";
+        uploadFd_ = mkstemp(&path[0]);
+        if(uploadFd_ < 0) {
+            LOG_ERROR("Create upload file in %s error: %d", uploadDir.c_str(), errno);
+            return false;
+        }
+        file.path = path;
+    }
+    files_.push_back(std::move(file));
+    return true;
+}
+
+bool HttpRequest::OnPartData_(const char* data, size_t len) {
+    if(!inFile_) {
+        //普通字段保存在内存中，总长度仍受maxBodySize限制
+        if(field_.valueLen + len > MAX_FIELD_SIZE || body_.size() + len > maxBodySize) {
+            LOG_ERROR("Multipart field too large");
+            return false;
+        }
+        body_.append(data, len);
+        field_.valueLen += len;
+        return true;
+    }
+    UploadFile& file = files_.back();
+    file.size += len;
+    if(uploadCallback) {
+        return uploadCallback(file, data, len);
+    }
+    //直接写入临时文件，不在内存中积累
+    while(len > 0) {
+        ssize_t n = ::write(uploadFd_, data, len);
+        if(n < 0) {
+            if(errno == EINTR) { continue; }
+            LOG_ERROR("Write upload file %s error: %d", file.path.c_str(), errno);
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool HttpRequest::OnPartEnd_() {
+    if(!inFile_) {
+        //与urlencoded表单一样保存到post_，同名字段以最后一个为准
+        SetPost_(PostView_(field_.keyOff, field_.keyLen), PostView_(field_.valueOff, field_.valueLen));
+        return true;
+    }
+    inFile_ = false;
+    if(uploadCallback) {
+        return uploadCallback(files_.back(), nullptr, 0);
+    }
+    close(uploadFd_);
+    uploadFd_ = -1;
+    return true;
+}
+
+std::vector<HttpRequest::UploadFile> HttpRequest::TakeFiles() {
+    assert(uploadFd_ < 0); //请求已经解析完，文件都已关闭
+    std::vector<UploadFile> files;
+    files.swap(files_);
+    return files;
+}
+
+void HttpRequest::RemoveUploads_() {
+    if(uploadFd_ >= 0) {
+        close(uploadFd_);
+        uploadFd_ = -1;
+    }
+    for(const UploadFile& file: files_) {
+        if(!file.path.empty()) {
+            unlink(file.path.c_str());
+        }
+    }
+    files_.clear();
 }
 
 //解析表单信息
 void HttpRequest::ParsePost_() {
     //只考虑post请求，get请求没有请求体不用解析请求体
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
-        ParseFromUrlencoded_(); //解析请求体，保存键值对并且进行url解码
+    //multipart表单的字段在接收时已经保存到post_
+    bool urlencoded = EqualsIgnoreCase(GetHeader(CONTENT_TYPE), "application/x-www-form-urlencoded");
+    if(method() == "POST" && (urlencoded || multipart_)) {
+        if(urlencoded) {
+            ParseFromUrlencoded_(); //解析请求体，保存键值对并且进行url解码
+        }
         if(DEFAULT_HTML_TAG.count(path_)) { //注册或者登录行为
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             LOG_DEBUG("Tag:%d", tag);
             if(tag == 0 || tag == 1) { 
-                bool isLogin = (tag == 1); //tag为0为注册，tag为1为登录
-                //注册或者验证用户名密码，成功跳转到welcome
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
-                else {
-                    path_ = "/error.html";
-                }
+                verifyTag_ = tag; //解析时不查询数据库，留给Verify
             }
         }
     }   
 }
 
-//解析加密信息，即用户名和密码
+void HttpRequest::Verify() {
+    if(verifyTag_ < 0) {
+        return;
+    }
+    bool isLogin = (verifyTag_ == 1); //tag为0为注册，tag为1为登录
+    verifyTag_ = -1;
+    //注册或者验证用户名密码，成功跳转到welcome
+    if(UserVerify(GetPost("username"), GetPost("password"), isLogin)) {
+        path_ = "/welcome.html";
+    } 
+    else {
+        path_ = "/error.html";
+    }
+}
+
+//解析表单，即用户名和密码；在body_上就地解码，键值对是body_中的视图
+//例：title=test&sub%5B%5D=1&sub%5B%5D=2&sub%5B%5D=3
 void HttpRequest::ParseFromUrlencoded_() {
     if(body_.size() == 0) { return; }
-
-    string key, value;
-    int num = 0;
-    int n = body_.size();
-    int i = 0, j = 0;
-
-  //例：title=test&sub%5B%5D=1&sub%5B%5D=2&sub%5B%5D=3
-  //url编码：%符号在URL编码中用于表示一个特殊字符的编码值的开始
-  //它后面跟着两个十六进制数字，表示特殊字符的编码值。例如，"%20"表示空格字符的编码值。
-  //
-
-    for(; i < n; i++) {
-        char ch = body_[i];
-        switch (ch) {
-        case '=':
-            key = body_.substr(j, i - j);
-            j = i + 1;
-            break;
-        case '+':
-            body_[i] = ' ';
-            break;
-        case '%':
-            //url编码的解码
-            num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-            body_[i + 2] = num % 10 + '0';
-            body_[i + 1] = num / 10 + '0';
-            i += 2;
-            break;
-        case '&':
-            value = body_.substr(j, i - j);
-            j = i + 1;
-            post_[key] = value;
-            LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
-            break;
-        default:
-            break;
-        }
-    }
-    assert(j <= i);
-    if(post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
+    //同一线程反复使用，不为每个请求分配
+    static thread_local std::vector<UrlEncoded::Field> fields;
+    fields.clear();
+    UrlEncoded::Parse(&body_[0], &body_[0] + body_.size(), fields);
+    for(const UrlEncoded::Field& field: fields) {
+        SetPost_(field.first, field.second);
+        LOG_DEBUG("%.*s = %.*s", static_cast<int>(field.first.size()), field.first.data(),
+                  static_cast<int>(field.second.size()), field.second.data());
     }
 }
 
@@ -211,6 +549,8 @@ bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin
     }
 
     LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+    //等待数据库连接和查询都会阻塞当前线程，告知弹性线程池，有任务排队时增加线程
+    ThreadPool::Blocking blocking;
     MYSQL* sql;//获取一个mysql连接
     SqlConnRAII(&sql,  SqlConnPool::Instance());//将sql连接封装在一个RAII类，实现资源与对象的生命期绑定
     //代码bug：用匿名函数会导致立刻调用析构函数，则sqlconnRAII内部的sql_连接会被释放，但z这个释放也只是放到队列中，不影响mysql的访问？
@@ -285,26 +625,36 @@ std::string& HttpRequest::path(){
     return path_;
 }
 
-std::string HttpRequest::method() const {
-    return method_;
+std::string_view HttpRequest::method() const {
+    return View_(method_);
 }
 
-std::string HttpRequest::version() const {
-    return version_;
+std::string_view HttpRequest::version() const {
+    return View_(version_);
+}
+
+//key和value都是body_中的视图；只追加不去重，否则字段很多时解析是平方级的
+void HttpRequest::SetPost_(std::string_view key, std::string_view value) {
+    post_.push_back({ static_cast<size_t>(key.data() - body_.data()), key.size(),
+                      static_cast<size_t>(value.data() - body_.data()), value.size() });
+}
+
+//同名字段以最后一个为准，从后往前找
+std::string_view HttpRequest::GetPostView(std::string_view key) const {
+    for(auto it = post_.rbegin(); it != post_.rend(); ++it) {
+        if(PostView_(it->keyOff, it->keyLen) == key) {
+            return PostView_(it->valueOff, it->valueLen);
+        }
+    }
+    return std::string_view();
 }
 
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
-    }
-    return "";
+    return std::string(GetPostView(key));
 }
 
 std::string HttpRequest::GetPost(const char* key) const {
     assert(key != nullptr);
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
-    }
-    return "";
+    return std::string(GetPostView(key));
 }
\ No newline at end of file
@@ -5,14 +5,23 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
-#include <regex>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
 #include <errno.h>     
+#include <unistd.h>      //write, unlink
+#include <stdlib.h>      //mkstemp
 #include <mysql/mysql.h>  //mysql
 
 #include "../buffer/buffer.h"
+#include "httpscan.h"
+#include "multipart.h"
+#include "urlencoded.h"
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/threadpool.h"
 
 class HttpRequest {
 public:
@@ -32,48 +41,166 @@ public:
         FILE_REQUEST, //请求文件
         INTERNAL_ERROR,
         CLOSED_CONNECTION,
+        ENTITY_TOO_LARGE, //请求体超过maxBodySize（multipart请求为maxUploadSize）
+    };
+
+    //分块传输（Transfer-Encoding: chunked）请求体的解析状态
+    enum CHUNK_STATE {
+        CHUNK_SIZE,    //块长度行
+        CHUNK_DATA,    //块数据
+        CHUNK_DATA_END, //块数据后的\r\n
+        CHUNK_TRAILER, //最后一个块之后的尾部字段，以空行结束
     };
     
-    HttpRequest() { Init(); }
-    ~HttpRequest() = default;
+    //常用的头部字段，解析时记下值的位置，按下标O(1)查找
+    enum KNOWN_HEADER {
+        CONNECTION = 0,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        HOST,
+        RANGE,
+        ACCEPT_ENCODING,
+        IF_NONE_MATCH,
+        KNOWN_HEADER_COUNT,
+    };
+
+    //multipart/form-data请求中上传的文件
+    struct UploadFile {
+        std::string name;        //表单字段名
+        std::string filename;    //客户端给出的文件名
+        std::string contentType;
+        std::string path;        //保存内容的临时文件，没有被TakeFiles取走时在下一个请求开始或连接关闭时删除
+        size_t size = 0;
+    };
+
+    //上传文件的回调：每收到一段文件内容调用一次，文件结束时再以data为nullptr调用一次；返回false时中止请求
+    //设置后文件内容交给回调，不再写临时文件
+    typedef std::function<bool(const UploadFile& file, const char* data, size_t len)> UploadCallback;
+
+    HttpRequest(): uploadFd_(-1) { Init(); }
+    ~HttpRequest() { RemoveUploads_(); }
+
+    static const size_t MAX_HEAD_SIZE = 65536; //请求行和头部的最大长度
+    static const size_t INLINE_HEADERS = 32;   //不超过这个数量的头部存放在对象内，不分配内存
+    static const size_t DEFAULT_MAX_BODY = 8 << 20;
+    static const size_t DEFAULT_MAX_UPLOAD = static_cast<size_t>(1) << 30;
+    static size_t maxBodySize; //保存在内存中的请求体的最大长度，在读入请求体之前检查，超过时返回ENTITY_TOO_LARGE
+    //multipart请求体的最大长度：文件流式写入磁盘（或交给回调），不占内存，单独设置上限；普通字段仍受maxBodySize限制
+    static size_t maxUploadSize;
+    static const size_t MAX_FIELD_SIZE = 65536; //multipart中普通字段的最大长度
+    static std::string uploadDir;           //上传文件的临时目录
+    static UploadCallback uploadCallback;
 
     void Init();
-    bool parse(Buffer& buff);
+    HTTP_CODE parse(Buffer& buff);
+    bool IsFinished() const { return state_ == FINISH; }
 
+    //method、version和头部都是指向读缓冲区的视图，在下一次读入数据之前有效
+    //有请求体的请求在头部解析完后把头部复制出来，请求体边收边解码，读缓冲区不必容纳整个请求
     std::string path() const;
     std::string& path();
-    std::string method() const;
-    std::string version() const;
+    std::string_view method() const;
+    std::string_view version() const;
+    std::string_view GetHeader(std::string_view name) const; //不区分大小写，没有时返回空
+    std::string_view GetHeader(KNOWN_HEADER header) const {
+        return (knownMask_ >> header) & 1 ? View_(known_[header]) : std::string_view();
+    }
+    size_t HeaderCount() const { return headerCount_; }
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
+    std::string_view GetPostView(std::string_view key) const; //解码后的值，在下一个请求开始之前有效
+    const std::string& body() const { return body_; } //urlencoded表单解析后是就地解码的内容；multipart请求只保存普通字段
+    const std::vector<UploadFile>& files() const { return files_; }
+    //取走上传的文件，之后临时文件由调用者移走或删除，Init和析构不再删除它们
+    std::vector<UploadFile> TakeFiles();
 
-    bool IsKeepAlive() const;
+    bool IsKeepAlive() const { return keepAlive_; }
+
+    //登录注册请求在解析完后还需要查询数据库（会阻塞），由调用者决定在哪个线程里执行Verify
+    bool NeedVerify() const { return verifyTag_ >= 0; }
+    void Verify(); //查询数据库验证用户，根据结果改写请求的路径
 
     /* 
     todo 
-    void HttpConn::ParseFormData() {}
     void HttpConn::ParseJson() {}
     */
 
 private:
-    bool ParseRequestLine_(const std::string& line);//解析请求行
-    void ParseHeader_(const std::string& line);//解析请求头部
-    void ParseBody_(const std::string& line);//解析请求体
+    //请求中的一段，记录相对于base_的偏移，不复制数据
+    struct Span {
+        uint32_t off = 0;
+        uint32_t len = 0;
+    };
+
+    struct Header {
+        Span name;
+        Span value;
+    };
 
+    bool ParseRequestLine_(const char* begin, const char* end);//解析请求行
+    bool ParseHeader_(const char* begin, const char* end);//解析请求头部
+    HTTP_CODE ParseBody_(Buffer& buff);//解析请求体，取走已经解码的部分
+    HTTP_CODE ParseChunked_(Buffer& buff);
+    bool OnBodyData_(const char* data, size_t len); //收到一段解码后的请求体，multipart请求交给multipart_
+
+    //multipart_的回调：普通字段保存到body_和post_，文件写入临时文件或交给uploadCallback
+    bool OnPartBegin_(const MultipartParser::Part& part);
+    bool OnPartData_(const char* data, size_t len);
+    bool OnPartEnd_();
+    void RemoveUploads_(); //关闭并删除临时文件
+
+    HTTP_CODE ParseHeadersDone_(); //头部解析完后，取出常用的头部字段，确定请求体的长度和编码
+    HTTP_CODE InitMultipart_();
+    size_t BodyLimit_() const { return multipart_ ? maxUploadSize : maxBodySize; }
     void ParsePath_(); //解析请求资源的路径
     void ParsePost_();
     void ParseFromUrlencoded_(); //解析表单数据
+    void SetPost_(std::string_view key, std::string_view value);
+    std::string_view PostView_(size_t off, size_t len) const { return std::string_view(body_.data() + off, len); }
+
+    static int KnownHeader_(std::string_view name); //常用头部的下标，不是常用头部时返回-1
 
     static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);//验证用户登录
 
+    std::string_view View_(Span span) const { return std::string_view(base_ + span.off, span.len); }
+    Span Span_(const char* begin, const char* end) const {
+        return Span{ static_cast<uint32_t>(begin - base_), static_cast<uint32_t>(end - begin) };
+    }
+
     PARSE_STATE state_;//枚举类型，状态
-    std::string method_, path_, version_, body_;//请求行内容：请求方法，请求路径，协议版本；  请求体
-    std::unordered_map<std::string, std::string> header_;//请求头的内容，存放键和值，
-    std::unordered_map<std::string, std::string> post_;//请求报文中的post请求表单数据，主要是用户名和密码
+    int verifyTag_; //待验证的用户行为，-1为无，0为注册，1为登录
+    const char* base_; //请求在读缓冲区中的起始位置
+    size_t pos_;       //下一行的起始偏移，之前的部分已经解析
+    size_t scanned_;   //已经确认没有换行符的位置，下次从这里继续查找
+    Span method_, version_;//请求行内容：请求方法，协议版本
+    std::string path_, body_;//请求路径（会被改写，所以单独保存）；请求体
+    Header headers_[INLINE_HEADERS]; //请求头的内容，按出现顺序保存键和值
+    std::vector<Header> moreHeaders_; //超过INLINE_HEADERS的头部，通常为空，clear后容量保留
+    size_t headerCount_;
+    Span known_[KNOWN_HEADER_COUNT]; //常用头部的值，同名头部以第一个为准
+    uint32_t knownMask_;              //出现过的常用头部
+    bool keepAlive_; //头部解析完后确定，之后不再依赖读缓冲区
+    size_t contentLength_;
+    bool chunked_;
+    CHUNK_STATE chunkState_;
+    size_t bodyLeft_;  //当前（块）还没有收到的请求体长度
+    size_t bodySize_;  //已经收到的请求体长度
+    std::string head_; //有请求体时复制出来的请求行和头部，base_指向它
+    std::unique_ptr<MultipartParser> multipart_;
+    std::vector<UploadFile> files_;
+    bool inFile_;        //正在接收的部分是文件
+    int uploadFd_;       //正在写入的临时文件
+    //表单中的一个字段，记录键和值在body_中的位置（multipart请求接收时body_还会增长，所以不保存视图）
+    struct FormField {
+        size_t keyOff, keyLen;
+        size_t valueOff, valueLen;
+    };
+    std::vector<FormField> post_;//请求报文中的post请求表单数据，按出现顺序保存，查找时从后往前
+    FormField field_;  //正在接收的multipart普通字段
 
+    static const char* const KNOWN_HEADER_NAMES[KNOWN_HEADER_COUNT];
     static const std::unordered_set<std::string> DEFAULT_HTML;//默认的网页
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;//
-    static int ConverHex(char ch);//char转换成16进制
 };
 
 
@@ -2,35 +2,15 @@
 
 using namespace std;
 
-//文件类型：文件类型描述
-const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
-};
-
 //状态码：状态描述
 const unordered_map<int, string> HttpResponse::CODE_STATUS = {
     { 200, "OK" },
+    { 206, "Partial Content" },
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 413, "Payload Too Large" },
+    { 416, "Range Not Satisfiable" },
 };
 
 //错误状态码：显示对应错误的html
@@ -38,15 +18,19 @@ const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 400, "/400.html" },
     { 403, "/403.html" },
     { 404, "/404.html" },
+    { 413, "/413.html" },
 };
 
+const int HttpResponse::CACHED_CODES[5] = { 200, 400, 403, 404, 413 };
+static_assert(sizeof(HttpResponse::CACHED_CODES) / sizeof(int) * 2 == FileCache::Entry::RESPONSE_SLOTS,
+              "each cached code needs a keep-alive and a close slot");
+
 //构造函数
 HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr; 
-    mmFileStat_ = { 0 };
+    cached_ = nullptr;
 };
 
 //析构函数
@@ -57,51 +41,153 @@ HttpResponse::~HttpResponse() {
 //初始化响应对象
 void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
     assert(srcDir != "");
-    //内存映射的指针不为空，释放
-    if(mmFile_){ 
-        UnmapFile(); 
-    }
+    //释放上一个响应使用的文件
+    UnmapFile();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
-    mmFile_ = nullptr; 
-    mmFileStat_ = { 0 };
+    range_.clear();
+    ifRange_.clear();
+    ranges_.clear();
+    parts_.clear();
+    partsTail_.clear();
+}
+
+void HttpResponse::SetRange(std::string_view range, std::string_view ifRange) {
+    range_ = range;
+    ifRange_ = ifRange;
 }
 
 //创建一个响应对象，写到写缓冲区
 void HttpResponse::MakeResponse(Buffer& buff) {
     /* 判断请求的资源文件 */
-    //获取文件资源的状态信息，如果获取失败或者访问的资源是目录，404
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;
-    }
-    //没有权限，403
-    else if(!(mmFileStat_.st_mode & S_IROTH)) {
-        code_ = 403;
+    //已经是错误状态码（如400、413）时不再查找请求的资源，直接返回错误页面
+    if(code_ < 400) {
+        //从文件缓存获取文件资源，热点文件不需要系统调用；获取失败或者访问的资源是目录，404
+        file_ = FileCache::Instance()->Get(srcDir_, path_);
+        if(!file_ || S_ISDIR(file_->mode)) {
+            code_ = 404;
+        }
+        //没有权限，403
+        else if(!(file_->mode & S_IROTH)) {
+            code_ = 403;
+        }
+        //code默认值为-1，那么成功找到资源
+        else if(code_ == -1) { 
+            code_ = 200; 
+        }
     }
-    //code默认值为-1，那么成功找到资源
-    else if(code_ == -1) { 
-        code_ = 200; 
+    //请求了部分内容：206或416，不使用缓存的完整响应
+    if(code_ == 200 && !range_.empty()) {
+        ApplyRange_();
     }
     ErrorHtml_();
+    //小文件和错误页面直接使用缓存的完整响应，与文件内容一起作为一块发送
+    if(UseCachedResponse_()) {
+        return;
+    }
     AddStateLine_(buff); //往写缓冲区添加响应首行/状态行
     AddHeader_(buff);//往写缓冲区添加响应头部
     AddContent_(buff);//往写缓冲区添加响应正文
 }
 
-char* HttpResponse::File() {
-    return mmFile_;
+const char* HttpResponse::File() const {
+    if(cached_) {
+        return cached_->data();
+    }
+    if(!file_ || !file_->data || !parts_.empty()) {
+        return nullptr;
+    }
+    return file_->data + FileOffset();
+}
+
+FileCache::EntryPtr HttpResponse::ReleaseFile() {
+    cached_ = nullptr;
+    return std::move(file_);
 }
 
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    if(cached_) {
+        return cached_->size();
+    }
+    if(!file_ || !parts_.empty()) {
+        return 0;
+    }
+    return code_ == 206 ? ranges_[0].second : file_->size;
+}
+
+size_t HttpResponse::FileOffset() const {
+    return code_ == 206 && ranges_.size() == 1 ? ranges_[0].first : 0;
+}
+
+int HttpResponse::FileFd() const {
+    return !cached_ && file_ ? file_->fd : -1;
+}
+
+//状态码和是否保持连接对应的槽位，不缓存时返回-1
+int HttpResponse::ResponseSlot_(int code, bool isKeepAlive) {
+    for(size_t i = 0; i < sizeof(CACHED_CODES) / sizeof(CACHED_CODES[0]); i++) {
+        if(CACHED_CODES[i] == code) {
+            return static_cast<int>(i) * 2 + isKeepAlive;
+        }
+    }
+    return -1;
+}
+
+//错误页面也不存在时的响应，每个槽位启动后第一次使用时生成
+const string& HttpResponse::ErrorResponse_(int slot) {
+    static const vector<string> responses = [] {
+        vector<string> all;
+        for(int i = 0; i < FileCache::Entry::RESPONSE_SLOTS; i++) {
+            HttpResponse response;
+            response.code_ = CACHED_CODES[i / 2];
+            response.isKeepAlive_ = i % 2;
+            response.path_ = CODE_PATH.count(response.code_) ? CODE_PATH.find(response.code_)->second : "";
+            Buffer buff;
+            response.AddStateLine_(buff);
+            response.AddHeader_(buff);
+            response.ErrorContent(buff, "File NotFound!");
+            all.push_back(buff.RetrieveAllToStr());
+        }
+        return all;
+    }();
+    return responses[slot];
+}
+
+bool HttpResponse::UseCachedResponse_() {
+    int slot = ResponseSlot_(code_, isKeepAlive_);
+    if(slot < 0) {
+        return false;
+    }
+    if(!file_ || S_ISDIR(file_->mode)) {
+        if(code_ < 400) {
+            return false;
+        }
+        file_.reset();
+        cached_ = &ErrorResponse_(slot);
+        return true;
+    }
+    if(file_->size > SMALL_RESPONSE || file_->fd >= 0) {
+        return false;
+    }
+    cached_ = file_->Response(slot);
+    if(!cached_) {
+        Buffer buff;
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        AddContent_(buff);
+        string response = buff.RetrieveAllToStr();
+        response.append(file_->data ? file_->data : "", file_->size);
+        cached_ = file_->SetResponse(slot, std::move(response));
+    }
+    return true;
 }
 
 void HttpResponse::ErrorHtml_() {
     if(CODE_PATH.count(code_) == 1) {
         path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+        file_ = FileCache::Instance()->Get(srcDir_, path_);
     }
 }
 
@@ -123,6 +209,82 @@ void HttpResponse::AddStateLine_(Buffer& buff) {
     buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
 }
 
+//按Range选出要发送的范围；If-Range与文件当前的校验值不符，或者Range语法错误时，照常发送整个文件
+void HttpResponse::ApplyRange_() {
+    if(!file_ || !S_ISREG(file_->mode)) {
+        return;
+    }
+    if(!ifRange_.empty() && ifRange_ != file_->etag && ifRange_ != file_->lastModified) {
+        return;
+    }
+    if(!ParseRange_(range_, file_->size, ranges_)) {
+        ranges_.clear();
+        return;
+    }
+    code_ = ranges_.empty() ? 416 : 206;
+}
+
+//逗号分隔的多个范围，每个为first-last、first-或-suffix，前后可以有空白；空的元素忽略
+bool HttpResponse::ParseRange_(string_view value, size_t size, vector<pair<size_t, size_t>>& ranges) {
+    if(value.size() < 6 || strncasecmp(value.data(), "bytes=", 6) != 0) {
+        return false;
+    }
+    value.remove_prefix(6);
+    //十进制数字，超过范围时按最大值处理
+    auto number = [](string_view digits, unsigned long long* out) {
+        if(digits.empty()) {
+            return false;
+        }
+        unsigned long long n = 0;
+        for(char ch: digits) {
+            if(ch < '0' || ch > '9') {
+                return false;
+            }
+            n = n > (ULLONG_MAX - 9) / 10 ? ULLONG_MAX : n * 10 + (ch - '0');
+        }
+        *out = n;
+        return true;
+    };
+    size_t count = 0;
+    while(true) {
+        size_t comma = value.find(',');
+        string_view spec = value.substr(0, comma);
+        while(!spec.empty() && (spec.front() == ' ' || spec.front() == '\t')) { spec.remove_prefix(1); }
+        while(!spec.empty() && (spec.back() == ' ' || spec.back() == '\t')) { spec.remove_suffix(1); }
+        if(!spec.empty()) {
+            size_t dash = spec.find('-');
+            if(++count > MAX_RANGES || dash == string_view::npos) {
+                return false;
+            }
+            unsigned long long first = 0, last = ULLONG_MAX;
+            if(dash == 0) {
+                //最后last个字节
+                if(!number(spec.substr(1), &last)) {
+                    return false;
+                }
+                if(last > 0 && size > 0) {
+                    size_t len = static_cast<size_t>(std::min<unsigned long long>(last, size));
+                    ranges.emplace_back(size - len, len);
+                }
+            }
+            else {
+                if(!number(spec.substr(0, dash), &first) ||
+                   (dash + 1 < spec.size() && !number(spec.substr(dash + 1), &last)) || last < first) {
+                    return false;
+                }
+                if(first < size) {
+                    ranges.emplace_back(first, std::min<unsigned long long>(last, size - 1) - first + 1);
+                }
+            }
+        }
+        if(comma == string_view::npos) {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+    return count > 0;
+}
+
 //往写缓冲区中添加响应首部
 void HttpResponse::AddHeader_(Buffer& buff) {
     //Connection:keep-alive
@@ -133,55 +295,86 @@ void HttpResponse::AddHeader_(Buffer& buff) {
     } else{
         buff.Append("close\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    if(code_ == 206 && ranges_.size() > 1) {
+        //每一段的分隔符，只要不和文件内容冲突即可
+        static std::atomic<unsigned long> seq(time(nullptr));
+        char boundary[32];
+        snprintf(boundary, sizeof(boundary), "%016lx", seq++ * 0x9E3779B97F4A7C15ul);
+        partsTail_ = boundary;
+        buff.Append("Content-type: multipart/byteranges; boundary=" + partsTail_ + "\r\n");
+    }
+    else if(code_ == 416) {
+        //正文是生成的错误页面，不是文件内容
+        buff.Append("Content-type: text/html\r\n");
+    }
+    else {
+        buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    }
+    //文件内容：支持按范围请求，以及If-Range用到的校验值
+    if(file_ && S_ISREG(file_->mode) && (code_ == 200 || code_ == 206)) {
+        buff.Append("Accept-Ranges: bytes\r\nETag: " + file_->etag + "\r\nLast-Modified: " + file_->lastModified + "\r\n");
+    }
 }
 
 //往写缓冲区中添加响应正文，请求的资源放在响应正文
 void HttpResponse::AddContent_(Buffer& buff) {
-    //打开资源文件，得到一个文件描述符
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0) { 
-        ErrorContent(buff, "File NotFound!");
-        return; 
+    if(code_ == 416) {
+        buff.Append("Content-Range: bytes */" + to_string(file_->size) + "\r\n");
+        file_.reset();
+        ErrorContent(buff, "Range Not Satisfiable");
+        return;
+    }
+    if(code_ == 206) {
+        AddRangeContent_(buff);
+        return;
     }
-    
-    /* 使用mmap将文件映射到内存，提高文件的访问速度 
-        MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
+    //文件缓存中的文件已经映射到内存；错误页面也不存在时，直接生成错误信息
+    if(!file_ || S_ISDIR(file_->mode)) {
+        file_.reset();
         ErrorContent(buff, "File NotFound!");
         return; 
     }
-    mmFile_ = (char*)mmRet; //映射到内存的文件指针
-    close(srcFd);
+    LOG_DEBUG("file path %s%s", srcDir_.c_str(), path_.c_str());
     //最后的首部
     /* Conten-length：.... \r\n
        \r\n  */   
     //此时，响应报文的请求行和首部在写buffer里面，响应正文在内存映射中
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    buff.Append("Content-length: " + to_string(file_->size) + "\r\n\r\n");
 }
 
-//解除内存映射，释放内存映射指针
-void HttpResponse::UnmapFile() {
-    if(mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
+//206：一个范围时正文就是这一段文件；多个范围时每一段前面加上分隔符和这一段的Content-Range
+//只发送请求的部分，文件内容仍然由发送队列从内存映射或用sendfile发送
+void HttpResponse::AddRangeContent_(Buffer& buff) {
+    const string total = "/" + to_string(file_->size);
+    if(ranges_.size() == 1) {
+        size_t off = ranges_[0].first, len = ranges_[0].second;
+        buff.Append("Content-Range: bytes " + to_string(off) + "-" + to_string(off + len - 1) + total + "\r\n");
+        buff.Append("Content-length: " + to_string(len) + "\r\n\r\n");
+        return;
     }
+    const string boundary = partsTail_;
+    size_t length = 0;
+    for(size_t i = 0; i < ranges_.size(); i++) {
+        size_t off = ranges_[i].first, len = ranges_[i].second;
+        string head = (i == 0 ? "--" : "\r\n--") + boundary + "\r\nContent-Type: " + file_->type +
+                      "\r\nContent-Range: bytes " + to_string(off) + "-" + to_string(off + len - 1) + total + "\r\n\r\n";
+        length += head.size() + len;
+        parts_.push_back(FilePart{ std::move(head), off, len });
+    }
+    partsTail_ = "\r\n--" + boundary + "--\r\n";
+    length += partsTail_.size();
+    buff.Append("Content-length: " + to_string(length) + "\r\n\r\n");
 }
 
-//判断文件类型
-string HttpResponse::GetFileType_() {
-    //获取后缀，例如.html .jpg
-    string::size_type idx = path_.find_last_of('.');
-    if(idx == string::npos) {
-        return "text/plain";
-    }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
-    }
-    return "text/plain";
+//释放文件缓存的条目，没有其他使用者且已被淘汰时解除内存映射
+void HttpResponse::UnmapFile() {
+    file_.reset();
+    cached_ = nullptr;
+}
+
+//判断文件类型，文件缓存中已经按后缀算好
+const string& HttpResponse::GetFileType_() {
+    return file_ ? file_->type : FileCache::MimeType(path_);
 }
 
 void HttpResponse::ErrorContent(Buffer& buff, string message) {
@@ -3,26 +3,50 @@
 #define HTTP_RESPONSE_H
 
 #include <unordered_map>
-#include <fcntl.h>       // open
-#include <unistd.h>      // close
-#include <sys/stat.h>    // stat
-#include <sys/mman.h>    // mmap, munmap
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <climits>       // ULLONG_MAX
+#include <strings.h>     // strncasecmp
+#include <sys/stat.h>    // S_ISDIR
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "filecache.h"
 
 class HttpResponse {
 public:
+    static const size_t SMALL_RESPONSE = 32 << 10; //不超过这个大小的文件缓存完整的响应
+    static const int CACHED_CODES[5]; //缓存完整响应的状态码，与是否保持连接组合成FileCache::Entry的槽位
+    static const size_t MAX_RANGES = 16; //一个请求最多的范围数，超过时忽略Range，发送整个文件
+
+    //206 multipart/byteranges响应正文中的一段文件，head为这一段之前的分隔符和头部
+    struct FilePart {
+        std::string head;
+        size_t off;
+        size_t len;
+    };
+
     HttpResponse();
     ~HttpResponse();
 
     void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    //请求中的Range和If-Range，只对GET请求设置；在Init之后、MakeResponse之前调用
+    void SetRange(std::string_view range, std::string_view ifRange);
     void MakeResponse(Buffer& buff);
     void UnmapFile();
-    char* File();
+    //写缓冲区之后要发送的内容：文件，或者缓存的完整响应（此时写缓冲区中没有追加任何内容）
+    const char* File() const;
+    FileCache::EntryPtr ReleaseFile(); //交出文件缓存的条目，File()指向的内容在条目释放之前有效
     size_t FileLen() const;
+    int FileFd() const; //大文件用sendfile发送的文件描述符，此时File()为nullptr；其他情况为-1
+    size_t FileOffset() const; //206时从文件的哪个位置开始发送，File()已经加上了这个偏移
+    //多个范围时正文的各段和最后的结束分隔符，此时File()为nullptr；其他响应为空
+    const std::vector<FilePart>& Parts() const { return parts_; }
+    const std::string& PartsTail() const { return partsTail_; }
     void ErrorContent(Buffer& buff, std::string message);
     int Code() const { return code_; }
+    bool IsKeepAlive() const { return isKeepAlive_; }
 
 private:
     void AddStateLine_(Buffer &buff);
@@ -30,7 +54,14 @@ private:
     void AddContent_(Buffer &buff);
 
     void ErrorHtml_();
-    std::string GetFileType_();
+    void ApplyRange_();
+    void AddRangeContent_(Buffer& buff);
+    //Range: bytes=0-99,200-,-50，按文件大小算出(偏移, 长度)；语法错误时返回false，都不能满足时ranges为空
+    static bool ParseRange_(std::string_view value, size_t size, std::vector<std::pair<size_t, size_t>>& ranges);
+    bool UseCachedResponse_();
+    static int ResponseSlot_(int code, bool isKeepAlive);
+    static const std::string& ErrorResponse_(int slot);
+    const std::string& GetFileType_();
 
     int code_; //响应状态码
     bool isKeepAlive_;//是否保持连接
@@ -38,10 +69,14 @@ private:
     std::string path_;//资源路径
     std::string srcDir_; //资源目录
     
-    char* mmFile_; //文件内存映射的指针
-    struct stat mmFileStat_; //文件的状态信息
+    FileCache::EntryPtr file_; //请求的文件：内存映射和状态信息，来自文件缓存
+    const std::string* cached_; //缓存的完整响应，属于file_或者预先生成的错误页面
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
+    std::string range_;   //请求的Range，为空表示发送整个文件
+    std::string ifRange_; //请求的If-Range，与文件的ETag或Last-Modified不同时忽略Range
+    std::vector<std::pair<size_t, size_t>> ranges_; //206时要发送的(偏移, 长度)
+    std::vector<FilePart> parts_;
+    std::string partsTail_;
     static const std::unordered_map<int, std::string> CODE_STATUS;
     static const std::unordered_map<int, std::string> CODE_PATH;
 };
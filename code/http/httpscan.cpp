@@ -0,0 +1,266 @@
+#include "httpscan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86
+#endif
+
+//token字符：字母数字和!#$%&'*+-.^_`|~
+//另外按低4位、高4位拆成两张16项的表，供向量实现用pshufb查表：
+//lo[c & 0xf]的第h位表示高4位为h的字符是token字符，hi[h] = 1 << h（h >= 8时为0）
+//两次查表结果按位与不为0，就是token字符
+struct TokenTable {
+    bool token[256];
+    alignas(16) unsigned char lo[16];
+    alignas(16) unsigned char hi[16];
+
+    TokenTable(): token(), lo(), hi() {
+        for(int c = '0'; c <= '9'; c++) { token[c] = true; }
+        for(int c = 'a'; c <= 'z'; c++) { token[c] = token[c - 'a' + 'A'] = true; }
+        for(const char* c = "!#$%&'*+-.^_`|~"; *c; c++) { token[static_cast<unsigned char>(*c)] = true; }
+        for(int c = 0; c < 128; c++) {
+            if(token[c]) { lo[c & 0xf] |= 1 << (c >> 4); }
+        }
+        for(int h = 0; h < 8; h++) { hi[h] = 1 << h; }
+    }
+};
+
+static const TokenTable& Table() {
+    static const TokenTable table;
+    return table;
+}
+
+bool HttpScan::IsTokenChar(unsigned char ch) {
+    return Table().token[ch];
+}
+
+/* ---------------- 逐字节 ---------------- */
+
+static const char* FindCRLFScalar(const char* begin, const char* end) {
+    const char* p = begin;
+    while(p < end) {
+        p = static_cast<const char*>(memchr(p, '\r', end - p));
+        if(!p || p + 1 >= end) {
+            return end;
+        }
+        if(p[1] == '\n') {
+            return p;
+        }
+        p++;
+    }
+    return end;
+}
+
+static const char* SkipTokenScalar(const char* begin, const char* end) {
+    const bool* token = Table().token;
+    const char* p = begin;
+    while(p < end && token[static_cast<unsigned char>(*p)]) { p++; }
+    return p;
+}
+
+static const char* FindSpaceOrCtlScalar(const char* begin, const char* end) {
+    const char* p = begin;
+    while(p < end && static_cast<unsigned char>(*p) > 0x20 && *p != 0x7f) { p++; }
+    return p;
+}
+
+static const char* FindFormDelimScalar(const char* begin, const char* end) {
+    const char* p = begin;
+    while(p < end && *p != '%' && *p != '+' && *p != '&' && *p != '=') { p++; }
+    return p;
+}
+
+#ifdef HTTP_SCAN_X86
+
+/* ---------------- SSE4.2，每次16字节 ---------------- */
+
+//\r和下一个字节的\n同时匹配；多读的一个字节要求p + 17 <= end
+__attribute__((target("sse4.2")))
+static const char* FindCRLFSse42(const char* begin, const char* end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char* p = begin;
+    for(; end - p >= 17; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindCRLFScalar(p, end);
+}
+
+__attribute__((target("sse4.2")))
+static const char* SkipTokenSse42(const char* begin, const char* end) {
+    const TokenTable& table = Table();
+    const __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(table.lo));
+    const __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(table.hi));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const char* p = begin;
+    for(; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nibble));
+        __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), _mm_setzero_si128()));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return SkipTokenScalar(p, end);
+}
+
+//pcmpestri按范围匹配：[0x00, 0x20]和0x7f
+__attribute__((target("sse4.2")))
+static const char* FindSpaceOrCtlSse42(const char* begin, const char* end) {
+    const __m128i ranges = _mm_setr_epi8(0x00, 0x20, 0x7f, 0x7f, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const char* p = begin;
+    for(; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(ranges, 4, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if(idx < 16) {
+            return p + idx;
+        }
+    }
+    return FindSpaceOrCtlScalar(p, end);
+}
+
+//pcmpestri按集合匹配：任意一个字节等于"%+&="中的一个
+__attribute__((target("sse4.2")))
+static const char* FindFormDelimSse42(const char* begin, const char* end) {
+    const __m128i set = _mm_setr_epi8('%', '+', '&', '=', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const char* p = begin;
+    for(; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(set, 4, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if(idx < 16) {
+            return p + idx;
+        }
+    }
+    return FindFormDelimScalar(p, end);
+}
+
+/* ---------------- AVX2，每次32字节 ---------------- */
+
+__attribute__((target("avx2")))
+static const char* FindCRLFAvx2(const char* begin, const char* end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char* p = begin;
+    for(; end - p >= 33; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf)));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindCRLFSse42(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* SkipTokenAvx2(const char* begin, const char* end) {
+    const TokenTable& table = Table();
+    //vpshufb在两个128位通道内分别查表，两个通道放同一张表
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table.lo)));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table.hi)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const char* p = begin;
+    for(; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble));
+        __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), _mm256_setzero_si256()));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return SkipTokenSse42(p, end);
+}
+
+//无符号比较：min(v, 0x20) == v即v <= 0x20
+__attribute__((target("avx2")))
+static const char* FindSpaceOrCtlAvx2(const char* begin, const char* end) {
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const char* p = begin;
+    for(; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i ctl = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(v, space), v), _mm256_cmpeq_epi8(v, del));
+        unsigned mask = _mm256_movemask_epi8(ctl);
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindSpaceOrCtlSse42(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* FindFormDelimAvx2(const char* begin, const char* end) {
+    const __m256i percent = _mm256_set1_epi8('%');
+    const __m256i plus = _mm256_set1_epi8('+');
+    const __m256i amp = _mm256_set1_epi8('&');
+    const __m256i eq = _mm256_set1_epi8('=');
+    const char* p = begin;
+    for(; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, percent), _mm256_cmpeq_epi8(v, plus)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, amp), _mm256_cmpeq_epi8(v, eq)));
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindFormDelimSse42(p, end);
+}
+
+#endif //HTTP_SCAN_X86
+
+const char* HttpScan::LevelName(LEVEL level) {
+    switch(level) {
+    case AVX2: return "avx2";
+    case SSE42: return "sse4.2";
+    default: return "scalar";
+    }
+}
+
+bool HttpScan::Supported(LEVEL level) {
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    switch(level) {
+    case AVX2: return __builtin_cpu_supports("avx2");
+    case SSE42: return __builtin_cpu_supports("sse4.2");
+    default: return true;
+    }
+#else
+    return level == SCALAR;
+#endif
+}
+
+HttpScan::Kernels HttpScan::Select_(LEVEL level) {
+#ifdef HTTP_SCAN_X86
+    if(level == AVX2) {
+        return Kernels{ AVX2, &FindCRLFAvx2, &SkipTokenAvx2, &FindSpaceOrCtlAvx2, &FindFormDelimAvx2 };
+    }
+    if(level == SSE42) {
+        return Kernels{ SSE42, &FindCRLFSse42, &SkipTokenSse42, &FindSpaceOrCtlSse42, &FindFormDelimSse42 };
+    }
+#endif
+    return Kernels{ SCALAR, &FindCRLFScalar, &SkipTokenScalar, &FindSpaceOrCtlScalar, &FindFormDelimScalar };
+}
+
+//第一次使用时选择CPU支持的最快实现
+HttpScan::Kernels& HttpScan::Kernels_() {
+    static Kernels kernels = Select_(Supported(AVX2) ? AVX2 : Supported(SSE42) ? SSE42 : SCALAR);
+    return kernels;
+}
+
+bool HttpScan::SetLevel(LEVEL level) {
+    if(!Supported(level)) {
+        return false;
+    }
+    Kernels_() = Select_(level);
+    return true;
+}
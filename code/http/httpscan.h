@@ -0,0 +1,52 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+//解析请求时用到的字符扫描，一次比较16或32个字节
+//启动时根据CPU支持的指令集选择实现：AVX2每次32字节，SSE4.2每次16字节，其他平台逐字节
+//所有实现的结果完全相同，尾部不足一个向量的部分逐字节处理，不会读越界
+class HttpScan {
+public:
+    enum LEVEL {
+        SCALAR = 0,
+        SSE42,
+        AVX2,
+    };
+
+    //查找\r\n，返回\r的位置，没有时返回end
+    static const char* FindCRLF(const char* begin, const char* end) { return Kernels_().findCRLF(begin, end); }
+
+    //跳过token字符（方法名、头部字段名），返回第一个不是token字符的位置
+    static const char* SkipToken(const char* begin, const char* end) { return Kernels_().skipToken(begin, end); }
+
+    //请求行中的url：返回第一个空格或控制字符（0x00-0x20、0x7f）的位置
+    static const char* FindSpaceOrCtl(const char* begin, const char* end) { return Kernels_().findSpaceOrCtl(begin, end); }
+
+    //urlencoded表单：返回第一个'%'、'+'、'&'、'='的位置
+    static const char* FindFormDelim(const char* begin, const char* end) { return Kernels_().findFormDelim(begin, end); }
+
+    static bool IsTokenChar(unsigned char ch);
+
+    static LEVEL Level() { return Kernels_().level; }
+    static const char* LevelName(LEVEL level);
+    static bool Supported(LEVEL level);
+    //切换实现，CPU不支持时返回false；只用于测试和性能对比，需在解析之前调用
+    static bool SetLevel(LEVEL level);
+
+private:
+    typedef const char* (*ScanFunc)(const char* begin, const char* end);
+
+    struct Kernels {
+        LEVEL level;
+        ScanFunc findCRLF;
+        ScanFunc skipToken;
+        ScanFunc findSpaceOrCtl;
+        ScanFunc findFormDelim;
+    };
+
+    static Kernels& Kernels_();
+    static Kernels Select_(LEVEL level);
+};
+
+#endif //HTTP_SCAN_H
@@ -0,0 +1,159 @@
+#include "multipart.h"
+
+//ASCII不区分大小写比较
+static bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    if(a.size() != b.size()) {
+        return false;
+    }
+    for(size_t i = 0; i < a.size(); i++) {
+        if(tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string_view Trim(std::string_view s) {
+    while(!s.empty() && (s.front() == ' ' || s.front() == '\t')) { s.remove_prefix(1); }
+    while(!s.empty() && (s.back() == ' ' || s.back() == '\t')) { s.remove_suffix(1); }
+    return s;
+}
+
+MultipartParser::MultipartParser(const std::string& boundary, const BeginCallback& onBegin,
+                                 const DataCallback& onData, const EndCallback& onEnd):
+        state_(PREAMBLE), delimiter_("\r\n--" + boundary), headSize_(0),
+        onBegin_(onBegin), onData_(onData), onEnd_(onEnd) {
+    //第一个分隔符前面没有\r\n，补上之后所有分隔符的形式相同
+    pending_ = "\r\n";
+}
+
+bool MultipartParser::Feed(const char* data, size_t len) {
+    pending_.append(data, len);
+    const char* p = pending_.data();
+    const char* end = p + pending_.size();
+    bool ok = true;
+    while(ok && p < end) {
+        if(state_ == PREAMBLE || state_ == DATA) {
+            const char* hit = static_cast<const char*>(memmem(p, end - p, delimiter_.data(), delimiter_.size()));
+            if(!hit) {
+                //最后几个字节可能是下一次送入的分隔符的开头，留到下次
+                size_t keep = std::min(static_cast<size_t>(end - p), delimiter_.size() - 1);
+                if(state_ == DATA && end - keep > p) {
+                    ok = onData_(p, end - keep - p);
+                }
+                p = end - keep;
+                break;
+            }
+            if(state_ == DATA) {
+                ok = (hit == p || onData_(p, hit - p)) && onEnd_();
+            }
+            p = hit + delimiter_.size();
+            state_ = DELIMITER;
+        }
+        else if(state_ == DELIMITER) {
+            if(end - p < 2) {
+                break;
+            }
+            if(p[0] == '-' && p[1] == '-') {
+                state_ = DONE;
+                continue;
+            }
+            //分隔符之后到\r\n之间只允许有空白
+            const char* q = p;
+            while(q < end && (*q == ' ' || *q == '\t')) { q++; }
+            if(end - q < 2) {
+                ok = q - p <= 64;
+                break;
+            }
+            if(q[0] != '\r' || q[1] != '\n') {
+                ok = false;
+                break;
+            }
+            p = q + 2;
+            part_ = Part();
+            headSize_ = 0;
+            state_ = PART_HEADERS;
+        }
+        else if(state_ == PART_HEADERS) {
+            const char* lineEnd = static_cast<const char*>(memmem(p, end - p, "\r\n", 2));
+            if(!lineEnd) {
+                ok = headSize_ + (end - p) <= MAX_PART_HEAD;
+                break;
+            }
+            headSize_ += lineEnd + 2 - p;
+            if(headSize_ > MAX_PART_HEAD) {
+                ok = false;
+            }
+            else if(lineEnd == p) {
+                //空行，头部结束
+                ok = onBegin_(part_);
+                state_ = DATA;
+            }
+            else {
+                ok = ParsePartHeader_(std::string_view(p, lineEnd - p));
+            }
+            p = lineEnd + 2;
+        }
+        else {
+            //结束之后的内容忽略
+            p = end;
+        }
+    }
+    pending_.erase(0, p - pending_.data());
+    return ok;
+}
+
+bool MultipartParser::ParsePartHeader_(std::string_view line) {
+    size_t colon = line.find(':');
+    if(colon == std::string_view::npos || colon == 0) {
+        return false;
+    }
+    std::string_view name = line.substr(0, colon);
+    std::string_view value = Trim(line.substr(colon + 1));
+    if(EqualsIgnoreCase(name, "Content-Disposition")) {
+        part_.name = Param(value, "name");
+        part_.filename = Param(value, "filename");
+    }
+    else if(EqualsIgnoreCase(name, "Content-Type")) {
+        part_.contentType.assign(value.data(), value.size());
+    }
+    return true;
+}
+
+//参数的格式：类型; key=value; key="带引号的值"，引号内的\可以转义
+std::string MultipartParser::Param(std::string_view value, std::string_view key) {
+    size_t pos = value.find(';');
+    while(pos != std::string_view::npos && pos < value.size()) {
+        pos++;
+        size_t eq = value.find_first_of("=;", pos);
+        std::string_view name = Trim(value.substr(pos, eq == std::string_view::npos ? std::string_view::npos : eq - pos));
+        if(eq == std::string_view::npos) {
+            break;
+        }
+        if(value[eq] == ';') {
+            pos = eq;
+            continue;
+        }
+        std::string result;
+        pos = eq + 1;
+        while(pos < value.size() && (value[pos] == ' ' || value[pos] == '\t')) { pos++; }
+        if(pos < value.size() && value[pos] == '"') {
+            for(pos++; pos < value.size() && value[pos] != '"'; pos++) {
+                if(value[pos] == '\\' && pos + 1 < value.size()) {
+                    pos++;
+                }
+                result += value[pos];
+            }
+            pos = value.find(';', pos);
+        }
+        else {
+            size_t semi = value.find(';', pos);
+            result.assign(Trim(value.substr(pos, semi == std::string_view::npos ? std::string_view::npos : semi - pos)));
+            pos = semi;
+        }
+        if(EqualsIgnoreCase(name, key)) {
+            return result;
+        }
+    }
+    return "";
+}
@@ -0,0 +1,64 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <algorithm>
+#include <ctype.h>      //tolower
+#include <string.h>     //memmem
+
+//流式解析multipart/form-data请求体，请求体可以分成任意大小的段依次送入
+//每个部分的内容收到多少就通过回调交出多少，只保留可能是分隔符开头的最后几个字节，
+//所以占用的内存与请求体大小无关
+//格式：--boundary\r\n头部\r\n\r\n内容\r\n--boundary\r\n头部\r\n\r\n内容\r\n--boundary--
+class MultipartParser {
+public:
+    //一个部分的头部
+    struct Part {
+        std::string name;        //Content-Disposition中的name
+        std::string filename;    //Content-Disposition中的filename，为空表示普通字段
+        std::string contentType;
+    };
+
+    //回调返回false时中止解析
+    typedef std::function<bool(const Part& part)> BeginCallback;
+    typedef std::function<bool(const char* data, size_t len)> DataCallback;
+    typedef std::function<bool()> EndCallback;
+
+    static const size_t MAX_PART_HEAD = 8192; //每个部分头部的最大长度
+
+    MultipartParser(const std::string& boundary, const BeginCallback& onBegin,
+                    const DataCallback& onData, const EndCallback& onEnd);
+    ~MultipartParser() = default;
+
+    bool Feed(const char* data, size_t len); //格式错误或回调返回false时返回false
+    bool IsDone() const { return state_ == DONE; } //已经收到结束的分隔符
+    const Part& CurrentPart() const { return part_; }
+
+    //取出头部字段值中的参数，如Param("form-data; name=\"a\"", "name")返回a，没有时返回空
+    static std::string Param(std::string_view value, std::string_view key);
+
+private:
+    enum STATE {
+        PREAMBLE,     //第一个分隔符之前的内容，丢弃
+        DELIMITER,    //分隔符之后：--表示结束，否则是\r\n
+        PART_HEADERS, //部分的头部
+        DATA,         //部分的内容
+        DONE,         //结束分隔符之后的内容，丢弃
+    };
+
+    bool ParsePartHeader_(std::string_view line);
+
+    STATE state_;
+    std::string delimiter_; //\r\n--boundary
+    std::string pending_;   //还没处理完的数据，不超过一次送入的长度加上分隔符的长度
+    size_t headSize_;       //当前部分头部已经收到的长度
+    Part part_;
+
+    BeginCallback onBegin_;
+    DataCallback onData_;
+    EndCallback onEnd_;
+};
+
+#endif //MULTIPART_H
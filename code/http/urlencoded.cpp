@@ -0,0 +1,70 @@
+#include "urlencoded.h"
+
+int UrlEncoded::HexValue_(char ch) {
+    if(ch >= '0' && ch <= '9') return ch - '0';
+    if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+char* UrlEncoded::DecodeUntil_(char* p, char* end, char* w, bool stopAtEq, char** out) {
+    while(true) {
+        //一段不需要解码的字节：还没有发生过解码时原地不动，否则整体前移
+        char* q = const_cast<char*>(HttpScan::FindFormDelim(p, end));
+        if(w != p) {
+            memmove(w, p, q - p);
+        }
+        w += q - p;
+        p = q;
+        if(p == end || *p == '&' || (*p == '=' && stopAtEq)) {
+            break;
+        }
+        if(*p == '+') {
+            *w++ = ' ';
+            p++;
+        }
+        else if(*p == '%' && end - p >= 3 && HexValue_(p[1]) >= 0 && HexValue_(p[2]) >= 0) {
+            *w++ = static_cast<char>(HexValue_(p[1]) * 16 + HexValue_(p[2]));
+            p += 3;
+        }
+        else {
+            //值中的'='，或不完整的%编码
+            *w++ = *p++;
+        }
+    }
+    *out = w;
+    return p;
+}
+
+char* UrlEncoded::Decode(char* begin, char* end) {
+    char* p = begin;
+    char* w = begin;
+    //'&'在这里不是分隔符，按原样保留后继续解码
+    while((p = DecodeUntil_(p, end, w, false, &w)) < end) {
+        *w++ = *p++;
+    }
+    return w;
+}
+
+void UrlEncoded::Parse(char* begin, char* end, std::vector<Field>& fields) {
+    char* p = begin;
+    while(p < end) {
+        //键：解码到'='或'&'为止
+        char* key = p;
+        char* keyEnd;
+        p = DecodeUntil_(p, end, key, true, &keyEnd);
+        char* value = p;
+        char* valueEnd = p;
+        if(p < end && *p == '=') {
+            //值：从'='之后开始解码，值中的'='按原样保留
+            value = ++p;
+            p = DecodeUntil_(p, end, value, false, &valueEnd);
+        }
+        if(keyEnd != key || valueEnd != value) {
+            fields.emplace_back(std::string_view(key, keyEnd - key), std::string_view(value, valueEnd - value));
+        }
+        if(p < end) {
+            p++; //'&'
+        }
+    }
+}
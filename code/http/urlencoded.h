@@ -0,0 +1,34 @@
+#ifndef URL_ENCODED_H
+#define URL_ENCODED_H
+
+#include <string.h>     //memmove
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "httpscan.h"
+
+//application/x-www-form-urlencoded的解析和百分号解码，都在原来的内存上就地进行
+//解码后的内容不会比原来长，所以从前往后写不会覆盖还没读到的数据
+//用HttpScan::FindFormDelim跳过不需要处理的字节，只在'%'、'+'、'&'、'='处停下
+class UrlEncoded {
+public:
+    typedef std::pair<std::string_view, std::string_view> Field;
+
+    //就地解码[begin, end)，返回解码后的结尾；'+'解码为空格
+    //%后面不是两位十六进制数字时按原样保留'%'
+    static char* Decode(char* begin, char* end);
+
+    //解析整个表单，解码后的键值对按出现顺序追加到fields，视图指向[begin, end)中解码后的内容
+    //例：title=test&sub%5B%5D=1 -> (title, test), (sub[], 1)；空的键值对（如&&）忽略，没有=时值为空
+    static void Parse(char* begin, char* end, std::vector<Field>& fields);
+
+private:
+    static int HexValue_(char ch); //十六进制数字的值，不是时返回-1
+
+    //从p开始解码，遇到'&'（stopAtEq时还有'='）或end时停止，解码结果写到w开始的位置
+    //返回停下的位置，*out为解码后的结尾
+    static char* DecodeUntil_(char* p, char* end, char* w, bool stopAtEq, char** out);
+};
+
+#endif //URL_ENCODED_H
@@ -8,7 +8,10 @@ int main() {
     WebServer server(
         1316, 3, 60000, false,             /* 端口 ET模式 超时时间 优雅退出  */
         3306, "root", "root", "webserver", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 数据库连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 0, true, 1, 1024,              /* 数据库连接池数量 线程池数量（0为按可用的核数） 日志开关 日志等级 日志异步队列容量 */
+        false, false,                      /* 多reactor模式（每个线程一个事件循环，线程数即上面的线程池数量） io_uring事件后端 */
+        WebServer::AFFINITY_NONE,          /* 线程绑核策略 */
+        8 << 20, 1 << 20, 1 << 30);        /* 请求体的最大字节数，超过时返回413  超过多少字节的文件用sendfile发送  上传（multipart）请求体的最大字节数 */
     
     server.Start(); //开启服务器
 } 
@@ -0,0 +1,122 @@
+#include "cputopology.h"
+
+CpuTopology* CpuTopology::Instance() {
+    static CpuTopology topology;
+    return &topology;
+}
+
+CpuTopology::CpuTopology(): nodeCount_(1), coreCount_(0) {
+    //可用的逻辑CPU
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> allowed;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &set)) { allowed.push_back(cpu); }
+        }
+    }
+    if(allowed.empty()) {
+        unsigned n = std::max(1u, std::thread::hardware_concurrency());
+        for(unsigned cpu = 0; cpu < n; cpu++) { allowed.push_back(cpu); }
+    }
+    nodeOf_.assign(allowed.back() + 1, 0);
+
+    //每个NUMA节点包含的CPU，没有/sys/devices/system/node时视为单节点
+    //节点编号可能不连续（如"0,2-3"），按online列出的编号逐个读取
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodes;
+    if(online && std::getline(online, nodes)) {
+        int count = 0;
+        for(int node: ParseCpuList_(nodes)) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if(!in || !std::getline(in, list)) {
+                continue;
+            }
+            count++;
+            for(int cpu: ParseCpuList_(list)) {
+                if(cpu < static_cast<int>(nodeOf_.size())) { nodeOf_[cpu] = node; }
+            }
+        }
+        nodeCount_ = std::max(1, count);
+    }
+
+    //同一物理核的超线程兄弟共用(节点, 物理封装, 核编号)，每个物理核的第一个逻辑CPU排在前面
+    struct Entry {
+        int smt;     //在所属物理核中是第几个逻辑CPU
+        int node;
+        int package;
+        int core;
+        int cpu;
+    };
+    std::vector<Entry> entries;
+    for(int cpu: allowed) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        Entry e = { 0, nodeOf_[cpu], ReadInt_(dir + "physical_package_id", 0),
+                    ReadInt_(dir + "core_id", cpu), cpu };
+        for(const Entry& prev: entries) {
+            if(prev.package == e.package && prev.core == e.core) { e.smt++; }
+        }
+        if(e.smt == 0) { coreCount_++; }
+        entries.push_back(e);
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if(a.smt != b.smt) { return a.smt < b.smt; }
+        return a.node < b.node;
+    });
+    for(const Entry& e: entries) {
+        cpus_.push_back(e.cpu);
+    }
+}
+
+int CpuTopology::NodeOf(int cpu) const {
+    if(cpu < 0 || cpu >= static_cast<int>(nodeOf_.size())) {
+        return 0;
+    }
+    return nodeOf_[cpu];
+}
+
+bool CpuTopology::BindThread(int cpu) const {
+    if(cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return false;
+    }
+    //单节点的机器不需要内存策略；MPOL_PREFERRED只是优先，本节点内存不足时仍可从其他节点分配
+    if(nodeCount_ > 1 && NodeOf(cpu) < 64) {
+        unsigned long mask = 1ul << NodeOf(cpu);
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8);
+    }
+    return true;
+}
+
+std::vector<int> CpuTopology::ParseCpuList_(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while(pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if(end == std::string::npos) { end = list.size(); }
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        if(!range.empty()) {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int cpu = first; cpu <= last; cpu++) { cpus.push_back(cpu); }
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+int CpuTopology::ReadInt_(const std::string& path, int defaultValue) {
+    std::ifstream in(path);
+    int value = defaultValue;
+    if(!(in >> value)) {
+        return defaultValue;
+    }
+    return value;
+}
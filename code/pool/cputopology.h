@@ -0,0 +1,46 @@
+#ifndef CPUTOPOLOGY_H
+#define CPUTOPOLOGY_H
+
+#include <sched.h>          //sched_getaffinity(), cpu_set_t
+#include <pthread.h>        //pthread_setaffinity_np()
+#include <sys/syscall.h>    //SYS_set_mempolicy
+#include <unistd.h>
+#include <linux/mempolicy.h> //MPOL_PREFERRED
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+//CPU拓扑：启动时从/sys读取每个逻辑CPU所属的物理核和NUMA节点，单例模式
+//用于给线程绑核，以及根据可用的核数决定线程数
+class CpuTopology {
+public:
+    static CpuTopology* Instance();
+
+    //本进程可用的逻辑CPU（受taskset/cgroup限制），排列顺序：
+    //先是每个物理核的第一个逻辑CPU，再是超线程的兄弟CPU；同一层内按NUMA节点聚在一起
+    //按顺序分配时线程先铺满物理核，相邻的线程落在同一节点
+    const std::vector<int>& Cpus() const { return cpus_; }
+
+    int NodeOf(int cpu) const;  //cpu所属的NUMA节点，未知时为0
+    int NodeCount() const { return nodeCount_; }
+    int CoreCount() const { return coreCount_; } //可用的物理核数
+
+    //把调用线程绑定到cpu上；有多个NUMA节点时，该线程之后分配的内存优先放在cpu所在的节点
+    bool BindThread(int cpu) const;
+
+private:
+    CpuTopology();
+    ~CpuTopology() = default;
+
+    static std::vector<int> ParseCpuList_(const std::string& list); //解析"0-3,8-11"这样的列表（CPU或节点编号）
+    static int ReadInt_(const std::string& path, int defaultValue);
+
+    std::vector<int> cpus_;
+    std::vector<int> nodeOf_;   //下标为逻辑CPU编号
+    int nodeCount_;
+    int coreCount_;
+};
+
+#endif //CPUTOPOLOGY_H
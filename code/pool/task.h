@@ -0,0 +1,175 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <assert.h>
+#include <new>          //placement new
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//线程池的任务：只能移动的无参可调用对象，替代std::function<void()>
+//不超过INLINE_SIZE字节的可调用对象（如捕获几个指针的lambda、std::bind）直接存放在对象内部，不分配堆内存
+//更大的可调用对象才退回到堆上
+class Task {
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    Task() noexcept : ops_(nullptr) {}
+
+    template<class F, class = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f) {
+        typedef typename std::decay<F>::type Fn;
+        Init_<Fn>(std::forward<F>(f), std::integral_constant<bool, IsInline_<Fn>()>());
+    }
+
+    Task(Task&& other) noexcept : ops_(other.ops_) {
+        if(ops_) {
+            ops_->move(&other.storage_, &storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if(this != &other) {
+            Reset();
+            ops_ = other.ops_;
+            if(ops_) {
+                ops_->move(&other.storage_, &storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { Reset(); }
+
+    void operator()() {
+        assert(ops_);
+        ops_->call(&storage_);
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void Reset() {
+        if(ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    typedef typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type Storage;
+
+    //手写的虚函数表，每种可调用类型一份
+    struct Ops {
+        void (*call)(void* self);
+        void (*move)(void* from, void* to);
+        void (*destroy)(void* self);
+    };
+
+    template<class Fn>
+    static constexpr bool IsInline_() {
+        return sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(Storage)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    //对象内存放
+    template<class Fn>
+    struct InlineOps {
+        static void Call(void* self) { (*static_cast<Fn*>(self))(); }
+        static void Move(void* from, void* to) {
+            new (to) Fn(std::move(*static_cast<Fn*>(from)));
+            static_cast<Fn*>(from)->~Fn();
+        }
+        static void Destroy(void* self) { static_cast<Fn*>(self)->~Fn(); }
+        static const Ops ops;
+    };
+
+    //堆上存放，对象内只保存指针
+    template<class Fn>
+    struct HeapOps {
+        static void Call(void* self) { (**static_cast<Fn**>(self))(); }
+        static void Move(void* from, void* to) { *static_cast<Fn**>(to) = *static_cast<Fn**>(from); }
+        static void Destroy(void* self) { delete *static_cast<Fn**>(self); }
+        static const Ops ops;
+    };
+
+    template<class Fn, class F>
+    void Init_(F&& f, std::true_type) {
+        new (&storage_) Fn(std::forward<F>(f));
+        ops_ = &InlineOps<Fn>::ops;
+    }
+
+    template<class Fn, class F>
+    void Init_(F&& f, std::false_type) {
+        *reinterpret_cast<Fn**>(&storage_) = new Fn(std::forward<F>(f));
+        ops_ = &HeapOps<Fn>::ops;
+    }
+
+    Storage storage_;
+    const Ops* ops_;
+};
+
+template<class Fn>
+const Task::Ops Task::InlineOps<Fn>::ops = { &Call, &Move, &Destroy };
+
+template<class Fn>
+const Task::Ops Task::HeapOps<Fn>::ops = { &Call, &Move, &Destroy };
+
+//预先分配的环形任务队列，接口与std::queue相同
+//槽位反复复用，入队出队不分配内存；只有队列满时才按两倍扩容
+class TaskQueue {
+public:
+    explicit TaskQueue(size_t capacity = 1024): head_(0), tail_(0) {
+        size_t n = 1;
+        while(n < capacity) { n <<= 1; }
+        ring_.resize(n);
+    }
+
+    bool empty() const { return head_ == tail_; }
+
+    size_t size() const { return tail_ - head_; }
+
+    template<class F>
+    void emplace(F&& f) {
+        if(size() == ring_.size()) {
+            Grow_();
+        }
+        ring_[tail_ & (ring_.size() - 1)] = Task(std::forward<F>(f));
+        tail_++;
+    }
+
+    Task& front() {
+        assert(!empty());
+        return ring_[head_ & (ring_.size() - 1)];
+    }
+
+    void pop() {
+        assert(!empty());
+        ring_[head_ & (ring_.size() - 1)].Reset();
+        head_++;
+    }
+
+private:
+    void Grow_() {
+        std::vector<Task> ring(ring_.size() * 2);
+        size_t n = size();
+        for(size_t i = 0; i < n; i++) {
+            ring[i] = std::move(ring_[(head_ + i) & (ring_.size() - 1)]);
+        }
+        ring_.swap(ring);
+        head_ = 0;
+        tail_ = n;
+    }
+
+    std::vector<Task> ring_; //容量是2的幂，下标用按位与取模
+    size_t head_;
+    size_t tail_;
+};
+
+#endif //TASK_H
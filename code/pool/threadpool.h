@@ -3,40 +3,172 @@
 
 #include <mutex> //互斥锁
 #include <condition_variable>//条件变量
-#include <queue>//队列
 #include <thread>//线程库，c++11
 #include <functional>//回调
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <assert.h>
+#include "task.h" //任务与预分配的环形任务队列
+#include "cputopology.h" //线程绑核
 
 //线程池的类
 class ThreadPool {
 public:
+    //调度方式
+    enum MODE {
+        AUTO,          //线程数超过STEALING_THRESHOLD时用工作窃取，否则用共享队列
+        SHARED_QUEUE,  //所有线程共用一个队列和一把锁
+        WORK_STEALING, //每个线程一个队列，任务轮流分发，空闲线程从其他线程的队列窃取
+    };
+
+    static const size_t STEALING_THRESHOLD = 8;
+
     //构造函数，默认创建8个线程
     //explicit关键字，防止构造函数进行隐式转换，必须使用构造函数创建
-    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>()) {
+    //cpus非空时，第i个线程绑定到cpus[i % cpus.size()]上
+    explicit ThreadPool(size_t threadCount = 8, MODE mode = AUTO,
+                        const std::vector<int>& cpus = std::vector<int>()): pool_(std::make_shared<Pool>()) {
             assert(threadCount > 0); //断言，测试用
 
+            if(mode == AUTO) {
+                mode = threadCount > STEALING_THRESHOLD ? WORK_STEALING : SHARED_QUEUE;
+            }
+            if(mode == WORK_STEALING) {
+                CreateWorkers_(threadCount, threadCount);
+            }
+
             //创建threadcount个子线程
+            pool_->cpus = cpus;
+            pool_->live = threadCount;
+            pool_->peak = threadCount;
             for(size_t i = 0; i < threadCount; i++) {
-                //c++创建线程的方式，花括号内为每个线程要执行的代码
-                std::thread([pool = pool_]{
-                    std::unique_lock<std::mutex> locker(pool->mtx); //获得unique_lock锁
-                    while(true) {
-                        if(!pool->tasks.empty()) { //任务队列不为空
-                            //从任务队列取第一个任务
-                            auto task = std::move(pool->tasks.front());//返回右值引用,并将资源转移到task
-                            //去掉队头的任务
-                            pool->tasks.pop();
-                            locker.unlock();
-                            task(); //任务执行的代码，functional
-                            locker.lock();
-                        } 
-                        else if(pool->isClosed) break; //任务队列为空，判断线程池是否关闭
-                        else pool->cond.wait(locker); //任务队列为空，线程池未关闭，阻塞
-                    }
-                }).detach(); //设置线程分离，从thread对象分离执行的线程,允许执行独立地持续。一旦线程退出,则释放所有分配的资源。
+                Spawn_(pool_, i);
+            }
+    }
+
+    //弹性线程池：线程数在[minThreads, maxThreads]之间变化
+    //队列积压或工作线程阻塞（见Blocking）时增加线程，线程空闲超过idleTimeoutMS后退出
+    //mode为AUTO时按maxThreads选择调度方式；工作窃取模式下每个线程的队列随线程一起启用和停用，
+    //后创建的线程先退出，0号线程一直存在
+    ThreadPool(size_t minThreads, size_t maxThreads, int idleTimeoutMS, MODE mode = AUTO,
+               const std::vector<int>& cpus = std::vector<int>()): pool_(std::make_shared<Pool>()) {
+        assert(minThreads > 0 && maxThreads >= minThreads && idleTimeoutMS > 0);
+        if(mode == AUTO) {
+            mode = maxThreads > STEALING_THRESHOLD ? WORK_STEALING : SHARED_QUEUE;
+        }
+        if(mode == WORK_STEALING) {
+            CreateWorkers_(maxThreads, minThreads);
+        }
+        pool_->elastic = true;
+        pool_->minThreads = minThreads;
+        pool_->maxThreads = maxThreads;
+        pool_->idleTimeout = std::chrono::milliseconds(idleTimeoutMS);
+        pool_->cpus = cpus;
+        pool_->live = minThreads;
+        pool_->peak = minThreads;
+        for(size_t i = 0; i < minThreads; i++) {
+            Spawn_(pool_, i);
+        }
+    }
+
+    //增减线程的原因
+    enum RESIZE_REASON {
+        GROW_BACKLOG,  //没有空闲线程，队列中积压的任务不少于线程数
+        GROW_BLOCKED,  //没有空闲线程，队列不为空，且有线程阻塞在数据库等操作上
+        SHRINK_IDLE,   //线程空闲超时
+    };
+
+    //一次增减线程的记录
+    struct ResizeEvent {
+        RESIZE_REASON reason;
+        size_t threads;  //调整后的线程数
+        size_t queued;   //当时队列中的任务数
+        size_t blocked;  //当时阻塞的线程数
+    };
+
+    //弹性线程池的运行状态
+    struct Stats {
+        size_t threads;
+        size_t idle;
+        size_t blocked;
+        size_t queued;
+        size_t peak;    //线程数的最大值
+        size_t grown;   //累计增加的线程数
+        size_t shrunk;  //累计退出的线程数
+    };
+
+private:
+    struct Pool;
+
+public:
+    //线程池中的线程在执行可能长时间阻塞的操作（如等待数据库）前构造一个Blocking对象，析构时解除
+    //有任务在排队而所有线程都忙时，弹性线程池据此立即增加线程；不在弹性线程池的线程中时什么也不做
+    class Blocking {
+    public:
+        Blocking(): pool_(Current_()) {
+            if(!pool_) {
+                return;
+            }
+            ResizeEvent event;
+            bool grow = false;
+            {
+                std::lock_guard<std::mutex> locker(pool_->mtx);
+                pool_->blocked++;
+                grow = Grow_(*pool_, GROW_BLOCKED, event);
+            }
+            if(grow) {
+                Spawn_(pool_->self.lock(), event.threads - 1);
+                Notify_(*pool_, event);
+            }
+        }
+
+        ~Blocking() {
+            if(pool_) {
+                std::lock_guard<std::mutex> locker(pool_->mtx);
+                pool_->blocked--;
             }
+        }
+
+        Blocking(const Blocking&) = delete;
+        Blocking& operator=(const Blocking&) = delete;
+
+    private:
+        Pool* pool_;
+    };
+
+    //设置增减线程时的回调（在工作线程或添加任务的线程中调用），应在添加任务之前设置
+    void SetResizeListener(std::function<void(const ResizeEvent&)> listener) {
+        std::lock_guard<std::mutex> locker(pool_->mtx);
+        pool_->listener = std::move(listener);
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> locker(pool_->mtx);
+        Stats stats;
+        stats.threads = pool_->live;
+        stats.idle = pool_->idle.load();
+        stats.blocked = pool_->blocked;
+        stats.queued = Queued_(*pool_);
+        stats.peak = pool_->peak;
+        stats.grown = pool_->grown;
+        stats.shrunk = pool_->shrunk;
+        return stats;
+    }
+
+    static const char* ReasonName(RESIZE_REASON reason) {
+        switch(reason) {
+        case GROW_BACKLOG: return "backlog";
+        case GROW_BLOCKED: return "blocked";
+        case SHRINK_IDLE: return "idle";
+        }
+        return "unknown";
     }
 
+
     //无参构造函数，因为上面已经定义有参构造函数，编译器不会帮忙定义无参构造，假如需要调用无参构造函数，就会报错
     ThreadPool() = default;
     //移动构造函数
@@ -55,21 +187,382 @@ public:
     //添加一个任务
     template<class F>
     void AddTask(F&& task) {//使用完美转发，根据传递进来的task类型调用相应的函数
+        if(!pool_->workers.empty()) {
+            //工作窃取：轮流放入各线程自己的队列，只锁这一个队列
+            //先计入pending再放入：放入后立刻被取走时fetch_sub不会先于fetch_add，pending不会下溢
+            size_t n = pool_->active.load();
+            pool_->pending.fetch_add(1);
+            {
+                std::unique_lock<std::mutex> locker;
+                Worker& worker = LockWorker_(pool_->next.fetch_add(1, std::memory_order_relaxed) % n, locker);
+                worker.tasks.emplace(std::forward<F>(task));
+            }
+            WakeOne_();
+            GrowStealing_();
+            return;
+        }
+        ResizeEvent event;
+        bool grow = false;
         {
             std::lock_guard<std::mutex> locker(pool_->mtx); //互斥锁，离开作用域自动解锁
             pool_->tasks.emplace(std::forward<F>(task)); //把任务添加到任务队列
+            grow = Grow_(*pool_, GROW_BACKLOG, event);
         }
         pool_->cond.notify_one(); //添加任务后，唤醒一个阻塞的线程去处理
+        if(grow) {
+            Spawn_(pool_, event.threads - 1);
+            Notify_(*pool_, event);
+        }
+    }
+
+    //批量添加任务，[first, last)中的元素会被移走
+    //一次加锁放入全部任务，只唤醒需要的线程数（不超过任务数和休眠线程数）
+    template<class Iter>
+    void AddTasks(Iter first, Iter last) {
+        size_t n = std::distance(first, last);
+        if(n == 0) {
+            return;
+        }
+        if(!pool_->workers.empty()) {
+            //工作窃取：把这一批切成连续的几段，每个线程的队列只加一次锁
+            size_t workerNum = pool_->active.load();
+            size_t start = pool_->next.fetch_add(workerNum, std::memory_order_relaxed);
+            size_t per = (n + workerNum - 1) / workerNum;
+            pool_->pending.fetch_add(n);
+            for(size_t w = 0; first != last; w++) {
+                std::unique_lock<std::mutex> locker;
+                Worker& worker = LockWorker_((start + w) % workerNum, locker);
+                for(size_t i = 0; i < per && first != last; i++, ++first) {
+                    worker.tasks.emplace(std::move(*first));
+                }
+            }
+            WakeSome_(n);
+            GrowStealing_();
+            return;
+        }
+        int wake = 0;
+        ResizeEvent event;
+        bool grow = false;
+        {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            for(; first != last; ++first) {
+                pool_->tasks.emplace(std::move(*first));
+            }
+            wake = static_cast<int>(std::min<size_t>(n, pool_->idle.load()));
+            grow = Grow_(*pool_, GROW_BACKLOG, event);
+        }
+        for(int i = 0; i < wake; i++) {
+            pool_->cond.notify_one();
+        }
+        if(grow) {
+            Spawn_(pool_, event.threads - 1);
+            Notify_(*pool_, event);
+        }
     }
 
 private:
+    //工作窃取模式下每个线程自己的队列
+    struct Worker {
+        std::mutex mtx;
+        TaskQueue tasks;
+        bool active = false; //该线程是否在运行，由mtx保护；已退出的线程的队列不再放入任务
+    };
+
 //定义一个结构体，池
     struct Pool {
-        std::mutex mtx;  //互斥锁
+        std::mutex mtx;  //互斥锁；工作窃取模式下只用于空闲线程的休眠和唤醒
         std::condition_variable cond; //条件变量
         bool isClosed; //是否关闭
-        std::queue<std::function<void()>> tasks;  //队列，保存任务
+        TaskQueue tasks;  //环形队列，保存任务，小任务入队不分配内存
+
+        //工作窃取模式下每个线程的队列，按线程数的上限一次创建好，不会重新分配；共享队列模式为空
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<size_t> active{0};  //工作窃取模式下运行中的线程数，即前多少个队列在使用
+        std::atomic<size_t> next{0};    //轮流分发任务的下标
+        std::atomic<size_t> pending{0}; //所有队列中的任务总数
+        std::atomic<int> idle{0};       //正在休眠的线程数（两种模式都统计）
+
+        //以下字段都由mtx保护
+        std::vector<int> cpus;          //非空时新线程依次绑定到这些核上
+        size_t spawned = 0;             //已创建过的线程数，用于选择绑定的核
+        size_t live = 0;                //当前的线程数
+        bool elastic = false;           //是否为弹性线程池
+        size_t minThreads = 0;
+        size_t maxThreads = 0;
+        std::chrono::milliseconds idleTimeout{0};
+        std::atomic<size_t> blocked{0}; //正在阻塞操作中的线程数，工作窃取模式下添加任务时不加锁读取
+        size_t peak = 0;
+        size_t grown = 0;
+        size_t shrunk = 0;
+        std::function<void(const ResizeEvent&)> listener;
+        std::weak_ptr<Pool> self;       //供Blocking创建线程时取得shared_ptr
     };
+
+    //当前线程所属的弹性线程池，不在弹性线程池中时为空
+    static Pool*& Current_() {
+        thread_local Pool* pool = nullptr;
+        return pool;
+    }
+
+    //创建工作窃取模式的count个队列，前active个启用
+    void CreateWorkers_(size_t count, size_t active) {
+        pool_->workers.reserve(count);
+        for(size_t i = 0; i < count; i++) {
+            pool_->workers.emplace_back(new Worker());
+            pool_->workers[i]->active = i < active;
+        }
+        pool_->active = active;
+    }
+
+    //排队的任务数
+    static size_t Queued_(const Pool& pool) {
+        return pool.workers.empty() ? pool.tasks.size() : pool.pending.load();
+    }
+
+    //在持有mtx时判断是否需要增加一个线程；需要时先把线程数计入live，由调用者解锁后创建
+    //新线程的下标为event.threads - 1，工作窃取模式下它的队列在这里启用
+    static bool Grow_(Pool& pool, RESIZE_REASON reason, ResizeEvent& event) {
+        size_t queued = Queued_(pool);
+        if(!pool.elastic || pool.isClosed || pool.live >= pool.maxThreads
+           || pool.idle.load() > 0 || queued == 0) {
+            return false;
+        }
+        if(reason == GROW_BACKLOG) {
+            //有线程阻塞时，只要有任务在排队就增加
+            if(pool.blocked > 0) {
+                reason = GROW_BLOCKED;
+            }
+            else if(queued < pool.live) {
+                return false;
+            }
+        }
+        if(!pool.workers.empty()) {
+            Worker& worker = *pool.workers[pool.live];
+            std::lock_guard<std::mutex> locker(worker.mtx);
+            worker.active = true;
+        }
+        pool.live++;
+        pool.active = pool.live;
+        pool.grown++;
+        pool.peak = std::max(pool.peak, pool.live);
+        event.reason = reason;
+        event.threads = pool.live;
+        event.queued = queued;
+        event.blocked = pool.blocked;
+        return true;
+    }
+
+    //工作窃取模式添加任务后：所有线程都在忙，且任务积压或有线程阻塞时才加锁判断是否增加线程
+    void GrowStealing_() {
+        if(!pool_->elastic || pool_->idle.load() > 0
+           || (pool_->pending.load() < pool_->active.load() && pool_->blocked.load() == 0)) {
+            return;
+        }
+        ResizeEvent event;
+        bool grow = false;
+        {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            grow = Grow_(*pool_, GROW_BACKLOG, event);
+        }
+        if(grow) {
+            Spawn_(pool_, event.threads - 1);
+            Notify_(*pool_, event);
+        }
+    }
+
+    //给下标为i的线程的队列加锁；该线程已经退出时改用0号线程的队列（0号线程不会退出）
+    Worker& LockWorker_(size_t i, std::unique_lock<std::mutex>& locker) {
+        Worker* worker = pool_->workers[i].get();
+        locker = std::unique_lock<std::mutex>(worker->mtx);
+        if(!worker->active) {
+            locker.unlock();
+            worker = pool_->workers[0].get();
+            locker = std::unique_lock<std::mutex>(worker->mtx);
+        }
+        return *worker;
+    }
+
+    static void Notify_(Pool& pool, const ResizeEvent& event) {
+        std::function<void(const ResizeEvent&)> listener;
+        {
+            std::lock_guard<std::mutex> locker(pool.mtx);
+            listener = pool.listener;
+        }
+        if(listener) {
+            listener(event);
+        }
+    }
+
+    //创建一个线程，调用前live已经计入了这个线程；id为工作窃取模式下该线程的队列下标
+    static void Spawn_(const std::shared_ptr<Pool>& pool, size_t id) {
+        int cpu = -1;
+        {
+            std::lock_guard<std::mutex> locker(pool->mtx);
+            if(!pool->cpus.empty()) {
+                //工作窃取模式下按队列下标绑核，同一个下标的线程退出后重新创建仍在原来的核上
+                size_t i = pool->workers.empty() ? pool->spawned : id;
+                cpu = pool->cpus[i % pool->cpus.size()];
+            }
+            pool->spawned++;
+            pool->self = pool;
+        }
+        //c++创建线程的方式；设置线程分离，从thread对象分离执行的线程,允许执行独立地持续。一旦线程退出,则释放所有分配的资源。
+        if(pool->workers.empty()) {
+            std::thread(SharedLoop_, pool, cpu).detach();
+        }
+        else {
+            std::thread(StealingLoop_, pool, id, cpu).detach();
+        }
+    }
+
+    //共享队列模式的线程
+    static void SharedLoop_(std::shared_ptr<Pool> pool, int cpu) {
+        if(cpu >= 0) { CpuTopology::Instance()->BindThread(cpu); }
+        if(pool->elastic) { Current_() = pool.get(); }
+        ResizeEvent event;
+        bool shrink = false;
+        std::unique_lock<std::mutex> locker(pool->mtx); //获得unique_lock锁
+        while(true) {
+            if(!pool->tasks.empty()) { //任务队列不为空
+                //从任务队列取第一个任务
+                auto task = std::move(pool->tasks.front());//返回右值引用,并将资源转移到task
+                //去掉队头的任务
+                pool->tasks.pop();
+                locker.unlock();
+                task(); //任务执行的代码，functional
+                locker.lock();
+            } 
+            else if(pool->isClosed) break; //任务队列为空，判断线程池是否关闭
+            else if(pool->elastic) {
+                //弹性线程池：空闲超时且线程数多于下限时退出
+                pool->idle++;
+                bool timeout = pool->cond.wait_for(locker, pool->idleTimeout) == std::cv_status::timeout;
+                pool->idle--;
+                if(timeout && pool->tasks.empty() && !pool->isClosed && pool->live > pool->minThreads) {
+                    pool->live--;
+                    pool->shrunk++;
+                    event.reason = SHRINK_IDLE;
+                    event.threads = pool->live;
+                    event.queued = 0;
+                    event.blocked = pool->blocked;
+                    shrink = true;
+                    break;
+                }
+            }
+            else {
+                //任务队列为空，线程池未关闭，阻塞
+                pool->idle++;
+                pool->cond.wait(locker);
+                pool->idle--;
+            }
+        }
+        locker.unlock();
+        Current_() = nullptr;
+        if(shrink) {
+            Notify_(*pool, event);
+        }
+    }
+
+    //有线程在休眠才去拿锁唤醒
+    //pending和idle都是顺序一致的原子操作：要么这里看到idle>0，要么休眠前的检查看到pending>0，不会丢失唤醒
+    void WakeOne_() {
+        if(pool_->idle.load() > 0) {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            pool_->cond.notify_one();
+        }
+    }
+
+    //唤醒至多n个休眠的线程
+    void WakeSome_(size_t n) {
+        if(pool_->idle.load() > 0) {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            size_t wake = std::min<size_t>(n, pool_->idle.load());
+            for(size_t i = 0; i < wake; i++) {
+                pool_->cond.notify_one();
+            }
+        }
+    }
+
+    //从队列头部取一个任务
+    static bool TryPop_(Worker& worker, Task& task) {
+        std::lock_guard<std::mutex> locker(worker.mtx);
+        if(worker.tasks.empty()) {
+            return false;
+        }
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop();
+        return true;
+    }
+
+    //弹性的工作窃取模式：持有mtx时让下标最大的线程退出，停用它的队列
+    //队列中还有任务（检查pending之后才放入的）时不退出
+    static bool Retire_(Pool& pool, size_t id, ResizeEvent& event) {
+        Worker& worker = *pool.workers[id];
+        std::lock_guard<std::mutex> locker(worker.mtx);
+        if(!worker.tasks.empty()) {
+            return false;
+        }
+        worker.active = false;
+        pool.live--;
+        pool.active = pool.live;
+        pool.shrunk++;
+        event.reason = SHRINK_IDLE;
+        event.threads = pool.live;
+        event.queued = 0;
+        event.blocked = pool.blocked;
+        return true;
+    }
+
+    //工作窃取模式的线程：先取自己的队列，空了就依次从其他线程的队列窃取，都没有任务再休眠
+    //弹性线程池中空闲超时的线程等到自己是下标最大的线程时退出，退出后唤醒其他线程，让下一个接着检查
+    static void StealingLoop_(std::shared_ptr<Pool> pool, size_t id, int cpu) {
+        if(cpu >= 0) { CpuTopology::Instance()->BindThread(cpu); }
+        if(pool->elastic) { Current_() = pool.get(); }
+        ResizeEvent event;
+        bool shrink = false;
+        Task task;
+        while(!shrink) {
+            size_t n = pool->active.load();
+            bool found = TryPop_(*pool->workers[id], task);
+            for(size_t i = 1; !found && i < n; i++) {
+                found = TryPop_(*pool->workers[(id + i) % n], task);
+            }
+            if(found) {
+                pool->pending.fetch_sub(1);
+                task();
+                task.Reset();
+                continue;
+            }
+            std::unique_lock<std::mutex> locker(pool->mtx);
+            pool->idle.fetch_add(1);
+            auto deadline = std::chrono::steady_clock::now() + pool->idleTimeout;
+            while(pool->pending.load() == 0 && !pool->isClosed) {
+                if(!pool->elastic) {
+                    pool->cond.wait(locker);
+                }
+                else if(std::chrono::steady_clock::now() < deadline) {
+                    pool->cond.wait_until(locker, deadline);
+                }
+                else if(id + 1 == pool->live && pool->live > pool->minThreads && Retire_(*pool, id, event)) {
+                    shrink = true;
+                    pool->cond.notify_all();
+                    break;
+                }
+                else {
+                    pool->cond.wait(locker);
+                }
+            }
+            pool->idle.fetch_sub(1);
+            if(pool->pending.load() == 0 && pool->isClosed) {
+                break; //任务都处理完且线程池已关闭
+            }
+        }
+        Current_() = nullptr;
+        if(shrink) {
+            Notify_(*pool, event);
+        }
+    }
+
     std::shared_ptr<Pool> pool_; //池，shared_ptr是引用计数型智能指针
 };
 
@@ -0,0 +1,65 @@
+#include "conntable.h"
+
+ConnTable::Chunk::Chunk() {
+    for(int i = 0; i < CHUNK; i++) {
+        gens[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+ConnTable::ConnTable(int maxFd): maxFd_(maxFd),
+    chunks_(new std::atomic<Chunk*>[(maxFd + CHUNK - 1) / CHUNK]) {
+    assert(maxFd > 0);
+    for(int i = 0; i < (maxFd_ + CHUNK - 1) / CHUNK; i++) {
+        chunks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ConnTable::~ConnTable() {
+    for(int i = 0; i < (maxFd_ + CHUNK - 1) / CHUNK; i++) {
+        Chunk* chunk = chunks_[i].load(std::memory_order_relaxed);
+        if(!chunk) { continue; }
+        for(int j = 0; j < CHUNK; j++) {
+            if(chunk->gens[j].load(std::memory_order_relaxed)) {
+                chunk->At(j)->~Slot();
+            }
+        }
+        delete chunk;
+    }
+}
+
+HttpConn* ConnTable::Alloc(int fd) {
+    assert(fd >= 0 && fd < maxFd_);
+    Chunk* chunk = chunks_[fd / CHUNK].load(std::memory_order_relaxed);
+    if(!chunk) {
+        //这一块第一次用到；其他线程只会通过已经发布的代数找到这里，先构造好再发布
+        chunk = new Chunk();
+        chunks_[fd / CHUNK].store(chunk, std::memory_order_release);
+    }
+    int i = fd % CHUNK;
+    uint32_t gen = chunk->gens[i].load(std::memory_order_relaxed);
+    assert((gen & 1) == 0); //上一个使用该fd的连接必须已经Free
+    if(gen == 0) {
+        new (chunk->At(i)) Slot(); //第一次使用该fd，原地构造
+    }
+    chunk->gens[i].store(gen + 1, std::memory_order_release);
+    return &chunk->At(i)->conn;
+}
+
+uint32_t ConnTable::Free(int fd) {
+    assert(fd >= 0 && fd < maxFd_);
+    Chunk* chunk = chunks_[fd / CHUNK].load(std::memory_order_acquire);
+    if(!chunk) {
+        return 0;
+    }
+    std::atomic<uint32_t>& slotGen = chunk->gens[fd % CHUNK];
+    uint32_t gen = slotGen.load(std::memory_order_relaxed);
+    uint32_t next;
+    do {
+        if((gen & 1) == 0) {
+            return 0;
+        }
+        //跳过0，0表示未构造
+        next = gen + 1 == 0 ? 2 : gen + 1;
+    } while(!slotGen.compare_exchange_weak(gen, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+    return next;
+}
@@ -0,0 +1,89 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "../http/httpconn.h"
+
+//按文件描述符下标的连接表，替代unordered_map<int, HttpConn>
+//槽位按缓存行对齐，每CHUNK个一块，块在其中的fd第一次被使用时才分配；HttpConn在fd第一次被使用时构造，之后一直复用
+//只有块指针数组按maxFd预留，连接少时每个reactor只占用用到的块
+//块分配后不会释放也不会移动对象，线程池中的线程持有的HttpConn*始终有效
+//每个槽位有一个代数，连接建立和关闭时各加一（奇数表示使用中，偶数表示空闲）
+//过期的事件或定时器回调带着旧的代数，连接关闭后或fd被复用后都能据此识别出来
+class ConnTable {
+public:
+    explicit ConnTable(int maxFd);
+    ~ConnTable();
+
+    ConnTable(const ConnTable&) = delete;
+    ConnTable& operator=(const ConnTable&) = delete;
+
+    //为新连接取出fd对应的槽位，代数加一变为奇数；只在所属的reactor线程调用
+    HttpConn* Alloc(int fd);
+
+    //连接关闭，代数加一变为偶数，之后带旧代数的事件和定时器都查不到这个连接
+    //返回关闭后的代数；槽位已经空闲（重复关闭）时不变，返回0
+    uint32_t Free(int fd);
+
+    //按fd取连接，槽位从未使用过返回nullptr
+    HttpConn* Get(int fd) {
+        assert(fd >= 0 && fd < maxFd_);
+        Chunk* chunk = chunks_[fd / CHUNK].load(std::memory_order_acquire);
+        return chunk && chunk->gens[fd % CHUNK].load(std::memory_order_acquire) ? &chunk->At(fd % CHUNK)->conn : nullptr;
+    }
+
+    //按fd和代数取连接，代数不符说明是已关闭或旧连接留下的事件，返回nullptr
+    HttpConn* Get(int fd, uint32_t gen) {
+        assert(fd >= 0 && fd < maxFd_);
+        Chunk* chunk = chunks_[fd / CHUNK].load(std::memory_order_acquire);
+        return gen != 0 && chunk && chunk->gens[fd % CHUNK].load(std::memory_order_acquire) == gen ?
+               &chunk->At(fd % CHUNK)->conn : nullptr;
+    }
+
+    //fd当前连接的代数，0表示槽位从未使用过，偶数表示连接已关闭
+    uint32_t Gen(int fd) const {
+        assert(fd >= 0 && fd < maxFd_);
+        const Chunk* chunk = chunks_[fd / CHUNK].load(std::memory_order_acquire);
+        return chunk ? chunk->gens[fd % CHUNK].load(std::memory_order_acquire) : 0;
+    }
+
+    //注册到事件后端的数据：高32位是代数，低32位是fd
+    uint64_t Token(int fd) const {
+        return (static_cast<uint64_t>(Gen(fd)) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    //由事件数据直接取连接，代数不符（过期事件）返回nullptr
+    HttpConn* Find(uint64_t token) {
+        int fd = static_cast<int>(static_cast<uint32_t>(token));
+        if(fd < 0 || fd >= maxFd_) { return nullptr; }
+        return Get(fd, static_cast<uint32_t>(token >> 32));
+    }
+
+    int MaxFd() const { return maxFd_; }
+
+    static const int CHUNK = 1024; //每块的槽位数
+
+private:
+    struct alignas(64) Slot {
+        HttpConn conn;
+    };
+
+    //一块槽位：代数和未构造的原始内存，代数为0的槽位没有构造
+    struct Chunk {
+        std::atomic<uint32_t> gens[CHUNK];
+        typename std::aligned_storage<sizeof(Slot), alignof(Slot)>::type slots[CHUNK];
+
+        Chunk();
+        Slot* At(int i) { return reinterpret_cast<Slot*>(&slots[i]); }
+    };
+
+    const int maxFd_;
+    std::unique_ptr<std::atomic<Chunk*>[]> chunks_; //(maxFd + CHUNK - 1) / CHUNK个，没用到的为nullptr
+};
+
+#endif //CONN_TABLE_H
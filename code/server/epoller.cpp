@@ -8,23 +8,23 @@ Epoller::~Epoller() {
     close(epollFd_);
 }
 
-bool Epoller::AddFd(int fd, uint32_t events) {
+bool Epoller::AddFd(int fd, uint32_t events, uint64_t data) {
     if(fd < 0) 
     return false;
 
-    //创建一个epoll_event
+    //创建一个epoll_event，data由调用者指定（低32位是fd）
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = data;
     ev.events = events;
     //调用epoll_ctl对epoll实例进行管理，这里是添加文件描述符信息
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
 }
 
-bool Epoller::ModFd(int fd, uint32_t events) {
+bool Epoller::ModFd(int fd, uint32_t events, uint64_t data) {
     if(fd < 0) 
     return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = data;
     ev.events = events;
     //调用epoll_ctl对epoll实例进行管理，这里是修改文件描述符信息
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
@@ -43,9 +43,9 @@ int Epoller::Wait(int timeoutMs) {
     return epoll_wait(epollFd_, &events_[0], static_cast<int>(events_.size()), timeoutMs);
 }
 
-int Epoller::GetEventFd(size_t i) const {
+uint64_t Epoller::GetEventData(size_t i) const {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return events_[i].data.u64;
 }
 
 uint32_t Epoller::GetEvents(size_t i) const {
@@ -8,23 +8,27 @@
 #include <vector>
 #include <errno.h>
 
-class Epoller {
+#include "poller.h"
+
+class Epoller : public Poller {
 public:
     explicit Epoller(int maxEvent = 1024);
 
-    ~Epoller();
-    //添加事件
-    bool AddFd(int fd, uint32_t events);
+    ~Epoller() override;
+    using Poller::AddFd;
+    using Poller::ModFd;
+    //添加事件，data在事件就绪时原样返回
+    bool AddFd(int fd, uint32_t events, uint64_t data) override;
     //修改事件
-    bool ModFd(int fd, uint32_t events);
+    bool ModFd(int fd, uint32_t events, uint64_t data) override;
 
-    bool DelFd(int fd);
+    bool DelFd(int fd) override;
     //调用内核，让内核帮忙检测
-    int Wait(int timeoutMs = -1);
+    int Wait(int timeoutMs = -1) override;
 
-    int GetEventFd(size_t i) const;
+    uint64_t GetEventData(size_t i) const override;
 
-    uint32_t GetEvents(size_t i) const;
+    uint32_t GetEvents(size_t i) const override;
         
 private:
     int epollFd_; //epoll_create创建一个epoll对象，返回值就是epollFd_，通过该描述符可以操作epoll对象
@@ -0,0 +1,600 @@
+#include "iouringpoller.h"
+
+IoUringPoller::IoUringPoller(int maxEvent): ringFd_(-1), sqRing_(MAP_FAILED), sqes_(nullptr),
+    cqRing_(MAP_FAILED), toSubmit_(0), bufRing_(nullptr), bufs_(nullptr), bufTail_(0),
+    wakeFd_(-1), wakeBuf_(0), wakeArmed_(false), events_(maxEvent) {
+    assert(events_.size() > 0);
+    Setup_(static_cast<unsigned>(maxEvent));
+}
+
+IoUringPoller::~IoUringPoller() {
+    Teardown_();
+}
+
+//io_uring_setup创建环形队列，再把提交队列、完成队列和sqe数组映射到用户空间
+//多次accept/接收、缓冲区环、异步取消按fd等需要6.0以上的内核，缺少任何一项都返回false
+bool IoUringPoller::Setup_(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    //多次请求会产生很多完成事件，完成队列取提交队列的4倍；COOP_TASKRUN：完成的处理推迟到本线程进入内核时，不打断事件循环
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * 4;
+    ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if(ringFd_ < 0) {
+        return false;
+    }
+    //Wait的超时需要EXT_ARG，取消和关闭不产生完成事件需要CQE_SKIP
+    const unsigned need = IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+    if((p.features & need) != need) {
+        Teardown_();
+        return false;
+    }
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMmap) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED) {
+        Teardown_();
+        return false;
+    }
+    cqRing_ = singleMmap ? sqRing_ : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+    if(cqRing_ == MAP_FAILED) {
+        Teardown_();
+        return false;
+    }
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        Teardown_();
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sqEntries_ = p.sq_entries;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    //eventfd不能设为非阻塞，否则io_uring上对它的读会直接返回EAGAIN，而不是等到有数据
+    wakeFd_ = eventfd(0, EFD_CLOEXEC);
+    if(wakeFd_ < 0 || !SetupBuffers_() || !Probe_()) {
+        Teardown_();
+        return false;
+    }
+    return true;
+}
+
+//分配缓冲区并注册缓冲区环，接收时内核从环中取空闲的缓冲区
+bool IoUringPoller::SetupBuffers_() {
+    void* ring = mmap(nullptr, BUF_COUNT * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED) {
+        return false;
+    }
+    bufRing_ = static_cast<io_uring_buf_ring*>(ring);
+    void* bufs = mmap(nullptr, BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(bufs == MAP_FAILED) {
+        return false;
+    }
+    bufs_ = static_cast<char*>(bufs);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BGID;
+    if(syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return false;
+    }
+    for(unsigned bid = 0; bid < BUF_COUNT; bid++) {
+        PutBuf_(bid);
+    }
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+    return true;
+}
+
+//在一对本地socket上试一次多次接收：先挂上接收再写入数据，确认内核没有对非阻塞socket直接返回EAGAIN，
+//数据放进了缓冲区环中的缓冲区，并且请求在对方关闭之前一直有效
+bool IoUringPoller::Probe_() {
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) {
+        return false;
+    }
+    uint64_t token = Token_(OP_PROBE, sv[0], 0);
+    bool ok = PrepRecv_(sv[0], token);
+    SubmitNow_();
+    ok = ok && toSubmit_ == 0 && write(sv[1], "x", 1) == 1;
+    close(sv[1]); //对方关闭，多次接收以长度为0的完成事件结束
+    bool data = false;
+    bool done = !ok;
+    while(!done) {
+        if(Enter_(0, 1, IORING_ENTER_GETEVENTS, 1000) < 0 && errno != EINTR) {
+            break;
+        }
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        for(; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+            if(cqe.user_data != token) {
+                continue;
+            }
+            if(cqe.flags & IORING_CQE_F_BUFFER) {
+                PutBuf_(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            if(cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER) && (cqe.flags & IORING_CQE_F_MORE)) {
+                data = true;
+            }
+            if(!(cqe.flags & IORING_CQE_F_MORE)) {
+                done = true;
+            }
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+    close(sv[0]);
+    return data && done;
+}
+
+void IoUringPoller::Teardown_() {
+    if(ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+    if(sqes_) {
+        munmap(sqes_, sqesSize_);
+        sqes_ = nullptr;
+    }
+    if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = MAP_FAILED;
+    if(sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+        sqRing_ = MAP_FAILED;
+    }
+    if(bufRing_) {
+        munmap(bufRing_, BUF_COUNT * sizeof(io_uring_buf));
+        bufRing_ = nullptr;
+    }
+    if(bufs_) {
+        munmap(bufs_, BUF_COUNT * BUF_SIZE);
+        bufs_ = nullptr;
+    }
+    if(wakeFd_ >= 0) {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
+}
+
+IoUringPoller::FdState& IoUringPoller::State_(int fd) {
+    if(static_cast<size_t>(fd) >= fds_.size()) {
+        fds_.resize(std::max(static_cast<size_t>(fd) + 1, fds_.size() * 2));
+    }
+    return fds_[fd];
+}
+
+//确保提交队列中还有n个空位，不够就先提交给内核；链接在一起的请求必须在同一次提交中
+bool IoUringPoller::Reserve_(unsigned n) {
+    if(*sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) + n > sqEntries_) {
+        SubmitNow_();
+    }
+    return *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) + n <= sqEntries_;
+}
+
+//取一个空闲的sqe并放入提交队列
+//没有使用SQPOLL，内核只在io_uring_enter时读取提交队列，先移动队尾再填写sqe也没有问题
+io_uring_sqe* IoUringPoller::GetSqe_() {
+    if(!Reserve_(1)) {
+        return nullptr;
+    }
+    unsigned tail = *sqTail_;
+    unsigned idx = tail & *sqMask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    toSubmit_++;
+    return sqe;
+}
+
+//多次accept：每来一个连接产生一个完成事件，新连接直接设为非阻塞（大文件的sendfile在事件循环中同步发送）
+void IoUringPoller::PrepAccept_(int fd, const FdState& st) {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = Token_(OP_ACCEPT, fd, st.gen);
+}
+
+//多次接收：每次收到数据，内核从缓冲区环取一个缓冲区放数据，产生一个完成事件
+bool IoUringPoller::PrepRecv_(int fd, uint64_t userData) {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BGID;
+    sqe->user_data = userData;
+    return true;
+}
+
+//userData不为0时取消user_data为userData的请求，否则取消fd上所有的请求；flags为sqe的标志（链接）
+void IoUringPoller::PrepCancel_(int fd, uint64_t userData, uint8_t flags) {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    if(userData) {
+        sqe->fd = -1;
+        sqe->addr = userData;
+    }
+    else {
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    }
+    sqe->flags = flags | IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = Token_(OP_IGNORE, fd, 0);
+}
+
+void IoUringPoller::PrepClose_(int fd) {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = Token_(OP_IGNORE, fd, 0);
+}
+
+void IoUringPoller::PrepWake_() {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeBuf_);
+    sqe->len = sizeof(wakeBuf_);
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->user_data = Token_(OP_WAKE, wakeFd_, 0);
+    wakeArmed_ = true;
+}
+
+int IoUringPoller::Enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, int timeoutMs) {
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if((flags & IORING_ENTER_GETEVENTS) && timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete,
+                                    flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)));
+}
+
+//把已写入提交队列的请求立即交给内核
+void IoUringPoller::SubmitNow_() {
+    while(toSubmit_ > 0) {
+        int ret = Enter_(toSubmit_, 0, 0, -1);
+        if(ret < 0) {
+            if(errno == EINTR) { continue; }
+            break;
+        }
+        toSubmit_ -= std::min(toSubmit_, static_cast<unsigned>(ret));
+    }
+}
+
+void IoUringPoller::PutBuf_(unsigned bid) {
+    //C++中__DECLARE_FLEX_ARRAY里的空结构体占1字节，bufRing_->bufs会错开8字节，直接把环当作io_uring_buf数组
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(bufRing_) + (bufTail_ & (BUF_COUNT - 1));
+    buf->addr = reinterpret_cast<uint64_t>(bufs_ + static_cast<size_t>(bid) * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = static_cast<uint16_t>(bid);
+    bufTail_++;
+}
+
+//调用者已经处理完上一次Wait的事件，把其中的缓冲区还给内核
+void IoUringPoller::RecycleBufs_() {
+    if(usedBufs_.empty()) {
+        return;
+    }
+    for(uint16_t bid: usedBufs_) {
+        PutBuf_(bid);
+    }
+    usedBufs_.clear();
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+}
+
+bool IoUringPoller::AddFd(int fd, uint32_t events, uint64_t data) {
+    if(fd < 0)
+    return false;
+    FdState& st = State_(fd);
+    if(st.registered) {
+        return false;
+    }
+    st.registered = true;
+    st.listen = false;
+    st.data = data;
+    st.gen++;
+    st.paused = !(events & EPOLLIN);
+    st.armed = !st.paused && PrepRecv_(fd, Token_(OP_RECV, fd, st.gen));
+    return true;
+}
+
+bool IoUringPoller::AddListenFd(int fd, uint32_t events) {
+    if(fd < 0)
+    return false;
+    FdState& st = State_(fd);
+    if(st.registered) {
+        return false;
+    }
+    st.registered = true;
+    st.listen = true;
+    st.data = static_cast<uint32_t>(fd);
+    st.gen++;
+    PrepAccept_(fd, st);
+    st.armed = true;
+    return true;
+}
+
+bool IoUringPoller::ModFd(int fd, uint32_t events, uint64_t data) {
+    if(fd < 0)
+    return false;
+    FdState& st = State_(fd);
+    if(!st.registered) {
+        return false;
+    }
+    st.data = data;
+    if(events & EPOLLIN) {
+        //继续接收；暂停时的取消还没完成的话，等它的完成事件到达后再重新挂上
+        if(st.paused) {
+            st.paused = false;
+            if(!st.armed) {
+                st.armed = PrepRecv_(fd, Token_(OP_RECV, fd, st.gen));
+            }
+        }
+    }
+    else if(!st.paused) {
+        //暂停接收，取消之前已经收到的数据照常返回
+        st.paused = true;
+        if(st.armed) {
+            PrepCancel_(fd, Token_(OP_RECV, fd, st.gen), 0);
+        }
+    }
+    //等待一次可写，没有EPOLLOUT不会取消已经在等的
+    if((events & EPOLLOUT) && !st.outPending) {
+        io_uring_sqe* sqe = GetSqe_();
+        if(!sqe) {
+            return false;
+        }
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = POLLOUT;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        sqe->poll32_events = (sqe->poll32_events << 16) | (sqe->poll32_events >> 16);
+#endif
+        sqe->user_data = Token_(OP_OUT, fd, st.gen);
+        st.outPending = true;
+        st.outData = data;
+    }
+    return true;
+}
+
+//取消fd上所有未完成的请求；之后的接收事件都是过期的，Send和等待可写的完成事件仍然返回
+bool IoUringPoller::DelFd(int fd) {
+    if(fd < 0)
+    return false;
+    FdState& st = State_(fd);
+    if(!st.registered) {
+        return false;
+    }
+    PrepCancel_(fd, 0, 0);
+    st.registered = false;
+    st.armed = false;
+    st.paused = false;
+    st.gen++;
+    return true;
+}
+
+//取消和关闭链接在一起，取消完成后才关闭；两者成功时都不产生完成事件
+bool IoUringPoller::CloseFd(int fd) {
+    if(fd < 0)
+    return false;
+    FdState& st = State_(fd);
+    if(st.registered) {
+        st.registered = false;
+        st.armed = false;
+        st.paused = false;
+        st.gen++;
+    }
+    if(!Reserve_(2)) {
+        return close(fd) == 0;
+    }
+    PrepCancel_(fd, 0, IOSQE_IO_HARDLINK);
+    PrepClose_(fd);
+    return true;
+}
+
+//closeAfter时发送、取消接收和关闭三个请求用硬链接（前一个失败后一个也执行）串在一起：
+//发送完（或出错）后取消fd上的多次接收，再关闭fd，事件循环不需要再为关闭提交请求
+bool IoUringPoller::Send(int fd, const struct msghdr* msg, int flags, bool closeAfter, uint64_t data) {
+    if(fd < 0)
+    return false;
+    FdState& st = State_(fd);
+    if(!st.registered || st.outPending || !Reserve_(closeAfter ? 3 : 1)) {
+        return false;
+    }
+    io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    //MSG_WAITALL：发送缓冲区满时内核等待可写后接着发，全部发完才产生完成事件
+    sqe->msg_flags = static_cast<uint32_t>(flags) | MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = Token_(OP_OUT, fd, st.gen);
+    st.outPending = true;
+    st.outData = data;
+    st.closeAfter = closeAfter;
+    if(closeAfter) {
+        sqe->flags = IOSQE_IO_HARDLINK;
+        PrepCancel_(fd, 0, IOSQE_IO_HARDLINK);
+        PrepClose_(fd);
+    }
+    return true;
+}
+
+//其他线程唤醒事件循环：写eventfd，完成挂在它上面的读
+void IoUringPoller::Wake() {
+    uint64_t one = 1;
+    ssize_t ret = write(wakeFd_, &one, sizeof(one));
+    (void)ret;
+}
+
+int IoUringPoller::Wait(int timeoutMs) {
+    //上一轮的事件已经处理完，缓冲区还给内核，再重新挂上结束了的多次请求
+    RecycleBufs_();
+    for(int fd: rearm_) {
+        FdState& st = fds_[fd];
+        if(!st.registered || st.armed || st.paused) {
+            continue;
+        }
+        if(st.listen) {
+            PrepAccept_(fd, st);
+            st.armed = true;
+        }
+        else {
+            st.armed = PrepRecv_(fd, Token_(OP_RECV, fd, st.gen));
+        }
+    }
+    rearm_.clear();
+    if(!wakeArmed_) {
+        PrepWake_();
+    }
+    //提交和等待合并为一次系统调用；完成队列里已经有事件就不再等待
+    bool ready = *cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    if(toSubmit_ > 0 || !ready) {
+        int ret = Enter_(toSubmit_, ready ? 0 : 1, ready ? 0 : IORING_ENTER_GETEVENTS, timeoutMs);
+        if(ret >= 0) {
+            toSubmit_ -= std::min(toSubmit_, static_cast<unsigned>(ret));
+        }
+        else if(errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return -1;
+        }
+    }
+    return Reap_();
+}
+
+//从完成队列中取出完成事件，转换成Poller的事件
+int IoUringPoller::Reap_() {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    for(; head != tail && n < events_.size(); head++) {
+        const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+        OP op = static_cast<OP>(cqe.user_data >> 56);
+        int fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+        uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32) & GEN_MASK;
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+        //用到的缓冲区先记下，下一次Wait时还给内核，过期的事件也一样
+        const char* buf = nullptr;
+        if(cqe.flags & IORING_CQE_F_BUFFER) {
+            unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            usedBufs_.push_back(static_cast<uint16_t>(bid));
+            buf = bufs_ + static_cast<size_t>(bid) * BUF_SIZE;
+        }
+        if(op == OP_WAKE) {
+            wakeArmed_ = false;
+            continue;
+        }
+        if(op == OP_IGNORE || op == OP_PROBE || fd < 0 || static_cast<size_t>(fd) >= fds_.size()) {
+            continue;
+        }
+        FdState& st = fds_[fd];
+        //Send和等待可写：同一时间只有一个，fd在它完成之前不会被复用，总是返回给调用者
+        if(op == OP_OUT) {
+            st.outPending = false;
+            events_[n++] = Event{ st.outData, EPOLLOUT, cqe.res, nullptr };
+            if(st.closeAfter) {
+                //链接在后面的取消和关闭接着执行，之后的接收事件都是过期的
+                st.closeAfter = false;
+                st.registered = false;
+                st.armed = false;
+                st.gen++;
+            }
+            continue;
+        }
+        if(!st.registered || (st.gen & GEN_MASK) != gen) {
+            if(op == OP_ACCEPT && cqe.res >= 0) {
+                close(cqe.res);
+            }
+            continue; //已经删除或关闭的fd
+        }
+        if(!more) {
+            st.armed = false;
+            rearm_.push_back(fd); //不需要继续的（暂停、对方关闭）在重新挂上时跳过
+        }
+        if(op == OP_ACCEPT) {
+            if(cqe.res >= 0) {
+                events_[n++] = Event{ st.data, EPOLLIN, cqe.res, nullptr };
+            }
+        }
+        else if(cqe.res > 0) {
+            events_[n++] = Event{ st.data, EPOLLIN, cqe.res, buf };
+        }
+        else if(cqe.res == 0) {
+            st.paused = true; //对方关闭，不再接收
+            events_[n++] = Event{ st.data, EPOLLRDHUP, 0, nullptr };
+        }
+        //缓冲区用完（ENOBUFS）或者暂停时被取消（ECANCELED）不是错误，重新挂上即可
+        else if(cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            st.paused = true;
+            events_[n++] = Event{ st.data, EPOLLERR, cqe.res, nullptr };
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return static_cast<int>(n);
+}
+
+uint64_t IoUringPoller::GetEventData(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].data;
+}
+
+uint32_t IoUringPoller::GetEvents(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].events;
+}
+
+int IoUringPoller::GetResult(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].result;
+}
+
+const char* IoUringPoller::GetBuffer(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].buf;
+}
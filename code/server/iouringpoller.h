@@ -0,0 +1,162 @@
+#ifndef IOURING_POLLER_H
+#define IOURING_POLLER_H
+
+#include <linux/io_uring.h> //io_uring_params, io_uring_sqe, io_uring_cqe, io_uring_buf_ring
+#include <sys/epoll.h>      //事件标志与Epoller保持一致
+#include <sys/eventfd.h>    //eventfd()
+#include <sys/mman.h>       //mmap()
+#include <sys/socket.h>
+#include <sys/syscall.h>    //__NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <poll.h>           //POLLOUT
+#include <unistd.h>         //close()
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "poller.h"
+
+//基于io_uring的完成模式事件后端：
+//监听socket挂一个多次accept（multishot accept），每个连接挂一个多次接收（multishot recv），
+//接收的数据由内核直接放进注册的缓冲区环（provided buffer ring），读不需要系统调用；
+//发送用SENDMSG，不保持连接时发送、取消和关闭链接在一起（hardlink），由内核在发送完后关闭；
+//所有请求先写入提交队列，在下一次Wait时与等待合并为一次io_uring_enter
+//除Wake外的所有方法只能在事件循环线程调用
+class IoUringPoller : public Poller {
+public:
+    explicit IoUringPoller(int maxEvent = 1024);
+
+    ~IoUringPoller() override;
+
+    //内核不支持io_uring（或缺少所需特性）时返回false，调用者应退回Epoller
+    bool IsValid() const { return ringFd_ >= 0; }
+
+    using Poller::AddFd;
+    using Poller::ModFd;
+
+    bool AddFd(int fd, uint32_t events, uint64_t data) override;
+
+    bool AddListenFd(int fd, uint32_t events) override;
+
+    bool ModFd(int fd, uint32_t events, uint64_t data) override;
+
+    bool DelFd(int fd) override;
+
+    bool CloseFd(int fd) override;
+
+    int Wait(int timeoutMs = -1) override;
+
+    uint64_t GetEventData(size_t i) const override;
+
+    uint32_t GetEvents(size_t i) const override;
+
+    bool IsCompletion() const override { return true; }
+
+    int GetResult(size_t i) const override;
+
+    const char* GetBuffer(size_t i) const override;
+
+    bool Send(int fd, const struct msghdr* msg, int flags, bool closeAfter, uint64_t data) override;
+
+    void Wake() override;
+
+    static const unsigned BUF_COUNT = 512;  //缓冲区环中的缓冲区个数，必须是2的幂
+    static const unsigned BUF_SIZE = 4096;  //每个缓冲区的大小，一次接收最多这么多字节
+
+private:
+    //请求的种类，放在user_data的最高8位
+    enum OP {
+        OP_IGNORE,  //取消和关闭，成功时不产生完成事件，失败的也不关心
+        OP_ACCEPT,
+        OP_RECV,
+        OP_OUT,     //Send或者等待可写，每个fd同时最多一个
+        OP_WAKE,
+        OP_PROBE,
+    };
+
+    //每个文件描述符的注册状态
+    struct FdState {
+        uint64_t data = 0;         //调用者附带的数据
+        uint64_t outData = 0;      //未完成的Send或等待可写附带的数据
+        uint32_t gen = 0;          //每次注册和删除加一，用于丢弃过期的接收事件
+        bool registered = false;   //是否已注册
+        bool listen = false;       //监听socket，挂的是accept
+        bool armed = false;        //内核中是否有未结束的多次accept/接收请求
+        bool paused = false;       //调用者暂停了接收
+        bool outPending = false;   //是否有未完成的Send或等待可写
+        bool closeAfter = false;   //未完成的Send之后由内核关闭fd
+    };
+
+    bool Setup_(unsigned entries);
+    bool SetupBuffers_();
+    bool Probe_();
+    void Teardown_();
+
+    io_uring_sqe* GetSqe_();
+    bool Reserve_(unsigned n);
+    void PrepAccept_(int fd, const FdState& st);
+    bool PrepRecv_(int fd, uint64_t userData);
+    void PrepCancel_(int fd, uint64_t userData, uint8_t flags);
+    void PrepClose_(int fd);
+    void PrepWake_();
+    int Enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, int timeoutMs);
+    void SubmitNow_();
+    void PutBuf_(unsigned bid);
+    void RecycleBufs_();
+    int Reap_();
+
+    FdState& State_(int fd);
+    static uint64_t Token_(OP op, int fd, uint32_t gen) {
+        return (static_cast<uint64_t>(op) << 56) | (static_cast<uint64_t>(gen & GEN_MASK) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    static const uint32_t GEN_MASK = 0xffffff; //user_data中代数占24位
+    static const uint16_t BGID = 0;            //缓冲区环的组号
+
+    int ringFd_;
+
+    //提交队列
+    void* sqRing_;
+    size_t sqRingSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqMask_;
+    unsigned* sqArray_;
+    unsigned sqEntries_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    //完成队列
+    void* cqRing_;
+    size_t cqRingSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqMask_;
+    io_uring_cqe* cqes_;
+
+    unsigned toSubmit_;        //已写入提交队列但还未提交给内核的请求数
+
+    //缓冲区环：内核从中取空闲的缓冲区放接收的数据，完成事件里带着缓冲区编号
+    io_uring_buf_ring* bufRing_;
+    char* bufs_;
+    uint16_t bufTail_;
+    std::vector<uint16_t> usedBufs_; //上一次Wait交给调用者的缓冲区，下一次Wait时还给内核
+
+    int wakeFd_;               //eventfd，Wake写入，事件循环上挂着它的读
+    uint64_t wakeBuf_;
+    bool wakeArmed_;
+
+    struct Event {
+        uint64_t data;
+        uint32_t events;
+        int result;
+        const char* buf;
+    };
+
+    std::vector<FdState> fds_;
+    std::vector<int> rearm_;   //多次请求结束了（缓冲区用完等）还要继续的fd，下一次Wait时重新挂上
+    std::vector<Event> events_;   //完成的事件
+};
+
+#endif //IOURING_POLLER_H
@@ -0,0 +1,59 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>     // close()
+#include <sys/socket.h> // msghdr
+
+//事件后端的公共接口，WebServer的事件循环通过它驱动epoll或io_uring
+//事件标志统一使用EPOLLIN/EPOLLOUT/EPOLLONESHOT等epoll的取值
+//注册时可以附带64位数据，事件就绪时原样取回；其低32位必须是fd，高32位由调用者自定义
+//
+//就绪模式（epoll）：Wait返回就绪的fd，由调用者自己accept、读写
+//完成模式（io_uring）：accept、接收、发送和关闭由后端执行，Wait返回完成的操作，事件标志表示完成的是什么：
+//  监听fd的EPOLLIN：accept完成，GetResult为新连接的fd
+//  连接的EPOLLIN：收到了数据，GetBuffer/GetResult为数据和长度，缓冲区在下一次Wait之前有效
+//  连接的EPOLLOUT：Send完成（GetResult为发送的字节数或-errno），或者ModFd等待的可写
+//  EPOLLRDHUP/EPOLLERR：对方关闭或接收出错
+class Poller {
+public:
+    virtual ~Poller() = default;
+    //添加事件；完成模式下开始在连接上接收数据
+    virtual bool AddFd(int fd, uint32_t events, uint64_t data) = 0;
+    bool AddFd(int fd, uint32_t events) { return AddFd(fd, events, static_cast<uint32_t>(fd)); }
+    //添加监听socket；完成模式下由后端accept
+    virtual bool AddListenFd(int fd, uint32_t events) { return AddFd(fd, events); }
+    //修改事件；完成模式下EPOLLIN表示继续接收（去掉则暂停），EPOLLOUT表示等待一次可写
+    virtual bool ModFd(int fd, uint32_t events, uint64_t data) = 0;
+    bool ModFd(int fd, uint32_t events) { return ModFd(fd, events, static_cast<uint32_t>(fd)); }
+
+    //删除事件；完成模式下取消fd上所有未完成的操作，取消的Send仍然会返回EPOLLOUT
+    virtual bool DelFd(int fd) = 0;
+    //删除事件并关闭fd；完成模式下在后端中异步关闭
+    virtual bool CloseFd(int fd) {
+        DelFd(fd);
+        return close(fd) == 0;
+    }
+    //等待事件，返回就绪的文件描述符个数
+    virtual int Wait(int timeoutMs = -1) = 0;
+
+    int GetEventFd(size_t i) const { return static_cast<int>(static_cast<uint32_t>(GetEventData(i))); }
+
+    //注册时附带的数据
+    virtual uint64_t GetEventData(size_t i) const = 0;
+
+    virtual uint32_t GetEvents(size_t i) const = 0;
+
+    //以下只用于完成模式
+    virtual bool IsCompletion() const { return false; }
+    virtual int GetResult(size_t i) const { return 0; }
+    virtual const char* GetBuffer(size_t i) const { return nullptr; }
+    //发送msg，全部发完（或出错）后返回一个EPOLLOUT；msg在完成之前不能修改
+    //closeAfter为true时发送完紧接着在后端中关闭fd，不再需要CloseFd
+    virtual bool Send(int fd, const struct msghdr* msg, int flags, bool closeAfter, uint64_t data) { return false; }
+    //唤醒阻塞在Wait中的事件循环，可以在任何线程调用
+    virtual void Wake() {}
+};
+
+#endif //POLLER_H
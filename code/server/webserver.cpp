@@ -6,9 +6,10 @@ WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
+            bool openLog, int logLevel, int logQueSize, bool multiReactor, bool ioUring, int affinity,
+            size_t maxBodySize, size_t sendfileThreshold, size_t maxUploadSize):
             port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller()){
+            multiReactor_(multiReactor), ioUring_(ioUring) {
     //  /home/joey/WebServer-master/resources/为服务器资源的根目录   
     srcDir_ = getcwd(nullptr, 256);  //获取当前工作路径的名称，传递nullptr就直接返回指针指向地址
     assert(srcDir_);
@@ -17,6 +18,11 @@ WebServer::WebServer(
     //初始化客户端连接类的静态变量，设置连接数为0和资源目录
     HttpConn::userCount = 0;
     HttpConn::srcDir = srcDir_;
+    HttpRequest::maxBodySize = maxBodySize;
+    HttpRequest::maxUploadSize = maxUploadSize;
+    FileCache::Instance()->SetSendfileThreshold(sendfileThreshold);
+    //客户端中途断开时，写（特别是sendfile）不能因为SIGPIPE结束进程，按EPIPE处理
+    signal(SIGPIPE, SIG_IGN);
 
     //初始化mysql连接池，单例模式，唯一实例，局部静态变量方法，生命周期为程序运行期
     //只要调用Instance()方法就可以访问得到这个唯一实例
@@ -25,9 +31,48 @@ WebServer::WebServer(
     //初始化事件的模式，ET模式，main中设置为3
     InitEventMode_(trigMode); 
 
-    //初始化套接字
-    if(!InitSocket_()){ 
-        isClose_ = true; //初始化套接字不成功，关闭服务器
+    //单reactor模式：主线程一个epoll循环，读写交给线程池
+    //多reactor模式：threadNum个线程各自运行一个epoll循环，各自accept自己的SO_REUSEPORT监听socket
+    //threadNum<=0时按本进程可用的核数决定线程数
+    const std::vector<int>& cpus = CpuTopology::Instance()->Cpus();
+    bool pin = affinity != AFFINITY_NONE;
+    //独占：单reactor模式下cpus[0]留给reactor线程，工作线程用其余的核（只有一个核时无法独占）
+    bool isolate = affinity == AFFINITY_ISOLATE && !multiReactor_ && cpus.size() > 1;
+    if(threadNum <= 0) {
+        threadNum = static_cast<int>(cpus.size()) - (isolate ? 1 : 0);
+    }
+    int reactorNum = 1;
+    if(multiReactor_) {
+        reactorNum = threadNum;
+    }
+    else {
+        std::vector<int> workerCpus;
+        if(pin) {
+            workerCpus.assign(cpus.begin() + (isolate ? 1 : 0), cpus.end());
+        }
+        //弹性线程池：队列积压时增加线程，最多为threadNum的两倍；线程多时自动使用工作窃取
+        threadpool_.reset(new ThreadPool(threadNum, threadNum * 2, POOL_IDLE_MS, ThreadPool::AUTO, workerCpus));
+        threadpool_->SetResizeListener([](const ThreadPool::ResizeEvent& event) {
+            LogResize_("ThreadPool", event);
+        });
+    }
+    //数据库请求单独一个弹性线程池，阻塞的线程数不会超过数据库连接数
+    sqlpool_.reset(new ThreadPool(1, std::max(1, connPoolNum), POOL_IDLE_MS));
+    sqlpool_->SetResizeListener([](const ThreadPool::ResizeEvent& event) {
+        LogResize_("SqlPool", event);
+    });
+    for(int i = 0; i < reactorNum && !isClose_; i++) {
+        std::unique_ptr<Reactor> reactor(new Reactor());
+        if(pin) {
+            reactor->cpu = cpus[i % cpus.size()];
+        }
+        reactor->poller = CreatePoller_();
+        reactor->timer.reset(new TimeWheel());
+        //初始化套接字
+        if(!InitSocket_(reactor.get())){
+            isClose_ = true; //初始化套接字不成功，关闭服务器
+        }
+        reactors_.push_back(std::move(reactor));
     }
 
     if(openLog) {
@@ -42,18 +87,47 @@ WebServer::WebServer(
             LOG_INFO("LogSys level: %d", logLevel);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
             LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("Reactor Mode: %s, Reactor num: %d",
+                            (multiReactor_ ? "multi-reactor" : "reactor + threadpool"), reactorNum);
+            LOG_INFO("IO Backend: %s", (ioUring_ ? "io_uring" : "epoll"));
+            LOG_INFO("CPU Affinity: %s, cpus: %d, cores: %d, numa nodes: %d",
+                            (affinity == AFFINITY_NONE ? "none" : (isolate ? "isolate reactor" : "pin")),
+                            static_cast<int>(cpus.size()), CpuTopology::Instance()->CoreCount(),
+                            CpuTopology::Instance()->NodeCount());
         }
     }
 }
 
 //析构函数
 WebServer::~WebServer() {
-    close(listenFd_);
+    for(auto& reactor: reactors_) {
+        if(reactor->listenFd >= 0) { close(reactor->listenFd); }
+    }
     isClose_ = true;
     free(srcDir_);
     SqlConnPool::Instance()->ClosePool();
 }
 
+//记录弹性线程池的增减，用于调整线程数的上下限
+void WebServer::LogResize_(const char* name, const ThreadPool::ResizeEvent& event) {
+    LOG_INFO("%s %s: %s, threads: %d, queued: %d, blocked: %d", name,
+             (event.reason == ThreadPool::SHRINK_IDLE ? "shrink" : "grow"),
+             ThreadPool::ReasonName(event.reason), static_cast<int>(event.threads),
+             static_cast<int>(event.queued), static_cast<int>(event.blocked));
+}
+
+//创建事件后端，要求io_uring但内核不支持时退回epoll
+std::unique_ptr<Poller> WebServer::CreatePoller_() {
+    if(ioUring_) {
+        std::unique_ptr<IoUringPoller> uring(new IoUringPoller());
+        if(uring->IsValid()) {
+            return std::move(uring);
+        }
+        ioUring_ = false;
+    }
+    return std::unique_ptr<Poller>(new Epoller());
+}
+
 //设置监听的文件描述符和通信的文件描述符的模式
 void WebServer::InitEventMode_(int trigMode) {
     listenEvent_ = EPOLLRDHUP; //监听事件，EPOLLRDHUP检测对方是否正常关闭
@@ -81,47 +155,99 @@ void WebServer::InitEventMode_(int trigMode) {
 
 //启动函数
 void WebServer::Start() {
-    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞，0代表不阻塞 */
     if(!isClose_){ LOG_INFO("========== Server start =========="); }
-    //主线程，只要不是处在关闭状态，就一直调用epollwait
+    //多reactor模式下，其余reactor各占一个线程，下标0的reactor由主线程运行
+    std::vector<std::thread> loops;
+    for(size_t i = 1; i < reactors_.size(); i++) {
+        loops.emplace_back(&WebServer::Loop_, this, reactors_[i].get());
+    }
+    Loop_(reactors_[0].get());
+    for(auto& t: loops) {
+        t.join();
+    }
+}
+
+//一个reactor的事件循环
+void WebServer::Loop_(Reactor* reactor) {
+    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞，0代表不阻塞 */
+    //只要不是处在关闭状态，就一直调用epollwait
+    //绑核后，本线程分配的连接缓冲区也优先落在所在的NUMA节点上
+    if(reactor->cpu >= 0) {
+        CpuTopology::Instance()->BindThread(reactor->cpu);
+    }
+    reactor->tid = std::this_thread::get_id();
+    reactor->conns.reset(new ConnTable(MAX_FD));
     while(!isClose_) {
         if(timeoutMS_ > 0) {
-            timeMS = timer_->GetNextTick(); //设定阻塞时间为到达下一个超时时间的时间长度
+            timeMS = reactor->timer->GetNextTick(); //设定阻塞时间为到达下一个超时时间的时间长度
         }
         //调用epoll_wait，返回发生变化的文件描述符的个数
-        int eventCnt = epoller_->Wait(timeMS); //设定阻塞时间，减少epollwait调用次数
+        int eventCnt = reactor->poller->Wait(timeMS); //设定阻塞时间，减少epollwait调用次数
+        //每轮只读一次时钟，本轮的添加和调整定时器都用这个时间
+        if(timeoutMS_ > 0) {
+            reactor->timer->UpdateClock();
+            CancelClosed_(reactor);
+        }
 
          /* 遍历处理事件 */
         for(int i = 0; i < eventCnt; i++) {
-            //从events_数组中获取发生了变化的文件描述符的信息
-            int fd = epoller_->GetEventFd(i);
-            uint32_t events = epoller_->GetEvents(i);
+            //从events_数组中获取发生了变化的事件，注册时附带的数据是连接的代数和fd
+            uint64_t data = reactor->poller->GetEventData(i);
+            uint32_t events = reactor->poller->GetEvents(i);
 
             //若返回的文件描述符与监听的文件描述符一致，说明监听的描述符有数据，代表有新连接，处理连接事件
-            if(fd == listenFd_) {
-                DealListen_(); //接受客户端连接
+            if(static_cast<int>(data) == reactor->listenFd) {
+                if(ioUring_) {
+                    DealAccept_(reactor, reactor->poller->GetResult(i)); //后端已经accept
+                }
+                else {
+                    DealListen_(reactor); //接受客户端连接
+                }
+                continue;
             }
 
             //文件描述符不是监听的描述符，是通信的描述符
+            //由事件数据直接定位到连接表中的httpcoon对象，代数不符说明是已关闭连接的过期事件
+            HttpConn* client = reactor->conns->Find(data);
+            if(!client) {
+                continue;
+            }
+            //完成模式：事件表示后端完成了什么操作
+            if(ioUring_) {
+                if(events & EPOLLOUT) {
+                    DealSent_(reactor, client, reactor->poller->GetResult(i));
+                }
+                else if(events & EPOLLIN) {
+                    DealRecv_(reactor, client, reactor->poller->GetBuffer(i), reactor->poller->GetResult(i));
+                }
+                else {
+                    CloseConn_(reactor, client);
+                }
+                continue;
+            }
             //连接出现了错误，关闭连接或者正常关闭连接
-            //users_是一个map，键为客户端socket的文件描述符，值为httpcoon对象
-            else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]); //关闭连接
+            if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                CloseConn_(reactor, client); //关闭连接
             }
             //通信描述符，读事件发生
             else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]); //处理读操作
+                DealRead_(reactor, client); //处理读操作
             }
             else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]); //处理写操作
+                DealWrite_(reactor, client); //处理写操作
             } 
             else {
                 LOG_ERROR("Unexpected event");
             }
         }
+        if(ioUring_) {
+            DrainReady_(reactor);
+        }
+        //本轮就绪的读写任务一次加锁全部放入线程池
+        if(!reactor->tasks.empty()) {
+            threadpool_->AddTasks(reactor->tasks.begin(), reactor->tasks.end());
+            reactor->tasks.clear();
+        }
     }
 }
 
@@ -134,95 +260,231 @@ void WebServer::SendError_(int fd, const char*info) {
     close(fd);
 }
 
-void WebServer::CloseConn_(HttpConn* client) {
+//关闭连接：先让槽位的代数失效，之后带旧代数的事件和定时器回调都会被丢弃，再取消定时器
+void WebServer::CloseConn_(Reactor* reactor, HttpConn* client) {
     assert(client);
-    LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
+    int fd = client->GetFd();
+    //完成模式：线程池还在处理或者内核还在发送时不能释放连接，等它们结束时再关闭；正在发送的先取消
+    if(ioUring_) {
+        HttpConn::AsyncState& st = client->Async();
+        if(st.busy || st.sending || st.blocked) {
+            if((st.sending || st.blocked) && !st.closing) {
+                reactor->poller->DelFd(fd);
+            }
+            st.closing = true;
+            return;
+        }
+    }
+    uint32_t gen = reactor->conns->Free(fd);
+    if(gen == 0) {
+        return; //已经关闭过
+    }
+    LOG_INFO("Client[%d] quit!", fd);
+    if(timeoutMS_ > 0) {
+        if(std::this_thread::get_id() == reactor->tid) {
+            reactor->timer->cancel(fd);
+        }
+        else {
+            std::lock_guard<std::mutex> locker(reactor->closedMtx);
+            reactor->closed.emplace_back(fd, gen);
+        }
+    }
+    //完成模式在事件后端中异步关闭fd，最后一次发送后已经由后端关闭的不再关闭
+    if(ioUring_) {
+        if(!client->Async().closeLinked) {
+            reactor->poller->CloseFd(fd);
+        }
+        client->Close(false);
+        return;
+    }
+    reactor->poller->DelFd(fd);
     client->Close();
 }
+
+//取消其他线程关闭的连接的定时器；fd已被新连接复用（代数变了）时定时器属于新连接，不能取消
+void WebServer::CancelClosed_(Reactor* reactor) {
+    std::vector<std::pair<int, uint32_t>> closed;
+    {
+        std::lock_guard<std::mutex> locker(reactor->closedMtx);
+        if(reactor->closed.empty()) {
+            return;
+        }
+        closed.swap(reactor->closed);
+    }
+    for(auto& item: closed) {
+        if(reactor->conns->Gen(item.first) == item.second) {
+            reactor->timer->cancel(item.first);
+        }
+    }
+}
 //添加客户端
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
+void WebServer::AddClient_(Reactor* reactor, int fd, sockaddr_in addr) {
     assert(fd > 0);
-    //创建一个新的httpconn的对象，进行初始化
-    //将连接对象添加到map集合
-    users_[fd].init(fd, addr);
+    //从连接表中取出fd对应的httpconn对象，进行初始化
+    HttpConn* client = reactor->conns->Alloc(fd);
+    client->init(fd, addr);
     if(timeoutMS_ > 0) {
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        uint32_t gen = reactor->conns->Gen(fd);
+        client->Touch(reactor->timer->Now());
+        reactor->timer->add(fd, timeoutMS_, std::bind(&WebServer::OnTimeout_, this, reactor, fd, gen));
     }
     //将新连接的fd添加到epoll对象，即在epoll内核事件表注册新连接客户端的读写事件，监听是否有数据到达
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
-    SetFdNonblock(fd); //设置非阻塞，
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    reactor->poller->AddFd(fd, EPOLLIN | connEvent_, reactor->conns->Token(fd));
+    //设置非阻塞，io_uring后端accept时已经设置
+    if(!ioUring_) {
+        SetFdNonblock(fd);
+    }
+    LOG_INFO("Client[%d] in!", client->GetFd());
 }
 
 //处理监听事件，有新的客户端连接
-void WebServer::DealListen_() {
+void WebServer::DealListen_(Reactor* reactor) {
     struct sockaddr_in addr; //保存连接的客户端的信息
     socklen_t len = sizeof(addr);
     do{
         //非阻塞模式，不会死循环，因为没有新的客户端连接后，accept会返回-1
         //accept会创建一个新的通信socket，返回创建的套接字的文件描述符
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
+        int fd = accept(reactor->listenFd, (struct sockaddr *)&addr, &len);
         if(fd <= 0){
             return;
         }
         //连接成功
-        else if(HttpConn::userCount >= MAX_FD) {//超出当前最大连接数量
+        else if(HttpConn::userCount >= MAX_FD || fd >= MAX_FD) {//超出当前最大连接数量
             SendError_(fd, "Server busy!");
             LOG_WARN("Clients is full!");
             return;
         }
         //添加客户端
-        AddClient_(fd, addr);
+        AddClient_(reactor, fd, addr);
     }while(listenEvent_ & EPOLLET);//对于ET模式，需要一次性连接
 }
 
-void WebServer::DealRead_(HttpConn* client) {
+//完成模式：后端accept了一个新连接
+void WebServer::DealAccept_(Reactor* reactor, int fd) {
+    if(fd <= 0) {
+        return;
+    }
+    if(HttpConn::userCount >= MAX_FD || fd >= MAX_FD) {//超出当前最大连接数量
+        SendError_(fd, "Server busy!");
+        LOG_WARN("Clients is full!");
+        return;
+    }
+    //多次accept不返回对方的地址，单独取
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if(getpeername(fd, (struct sockaddr *)&addr, &len) < 0) {
+        close(fd);
+        return;
+    }
+    AddClient_(reactor, fd, addr);
+}
+
+void WebServer::DealRead_(Reactor* reactor, HttpConn* client) {
     assert(client);
-    ExtentTime_(client);//发生读事件，延长超时时间
-    //在线程池的任务队列中添加任务，reactor模式读取数据交由子线程处理
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    ExtentTime_(reactor, client);//发生读事件，延长超时时间
+    client->Hold();
+    //多reactor模式：在本reactor线程内直接处理，不跨线程
+    if(multiReactor_) {
+        RunTask_(reactor, client, &WebServer::OnRead_);
+        return;
+    }
+    //reactor模式读取数据交由子线程处理，先攒到本轮的任务列表中，由Loop_批量提交
+    reactor->tasks.emplace_back([this, reactor, client] { RunTask_(reactor, client, &WebServer::OnRead_); });
 }
 
-void WebServer::DealWrite_(HttpConn* client) {
+void WebServer::DealWrite_(Reactor* reactor, HttpConn* client) {
     assert(client);
-    ExtentTime_(client);//发生写事件，延长超时时间
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    ExtentTime_(reactor, client);//发生写事件，延长超时时间
+    client->Hold();
+    if(multiReactor_) {
+        RunTask_(reactor, client, &WebServer::OnWrite_);
+        return;
+    }
+    reactor->tasks.emplace_back([this, reactor, client] { RunTask_(reactor, client, &WebServer::OnWrite_); });
 }
 
-void WebServer::ExtentTime_(HttpConn* client) {
+void WebServer::ExtentTime_(Reactor* reactor, HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    //只记录最后活跃时间，定时器到期时再检查，不用每次读写都调整定时器
+    if(timeoutMS_ > 0) { client->Touch(reactor->timer->Now()); }
+}
+
+//定时器到期：期间有过读写就按最后活跃时间重新定时，否则关闭连接
+void WebServer::OnTimeout_(Reactor* reactor, int fd, uint32_t gen) {
+    //连接可能已在别处关闭，fd又被新连接复用，代数不符时不能误关新连接
+    HttpConn* conn = reactor->conns->Get(fd, gen);
+    if(!conn) {
+        return;
+    }
+    //还有任务在使用这个连接（如等待很慢的数据库查询），不算空闲，从现在起重新计时
+    //新任务只由本线程派发，这里看到没有任务时，关闭连接期间也不会有任务开始
+    if(conn->InFlight()) {
+        conn->Touch(reactor->timer->Now());
+    }
+    uint64_t idle = reactor->timer->Now() - conn->LastActive();
+    if(idle < static_cast<uint64_t>(timeoutMS_)) {
+        reactor->timer->add(fd, timeoutMS_ - static_cast<int>(idle),
+                            std::bind(&WebServer::OnTimeout_, this, reactor, fd, gen));
+        return;
+    }
+    CloseConn_(reactor, conn);
+}
+
+//在线程池（多reactor模式下为reactor线程）中执行的任务，执行期间连接计为在使用中
+void WebServer::RunTask_(Reactor* reactor, HttpConn* client, Handler handler) {
+    (this->*handler)(reactor, client);
+    client->Release();
 }
 
-//在子线程中执行读事件
-void WebServer::OnRead_(HttpConn* client) {
+//在子线程（多reactor模式下为reactor线程）中执行读事件
+void WebServer::OnRead_(Reactor* reactor, HttpConn* client) {
     assert(client);
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno);//读取客户端的数据,读到客户端对象的读缓冲区
     if(ret <= 0 && readErrno != EAGAIN) { //发生错误或读取结束
-        CloseConn_(client);
+        CloseConn_(reactor, client);
         return;
     }
     //业务逻辑的处理
-    OnProcess(client); 
+    OnProcess(reactor, client);
 }
 
 //处理业务逻辑实际上就是处理HTTP请求
-void WebServer::OnProcess(HttpConn* client) {
-    //处理业务逻辑成功，修改文件描述符为可写，向epoll示例注册写事件，此时主线程一直在wait
-    //当主线程监听到可写，就会进行写事件处理
-    if(client->process()){
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
-    } 
-    else{
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+//流水线：读缓冲区中所有完整的请求依次解析，响应都排进发送队列，最后一起用writev发送
+void WebServer::OnProcess(Reactor* reactor, HttpConn* client) {
+    while(client->CanPipeline() && client->parse()) {
+        //登录注册要查询数据库，交给sqlpool_，当前线程继续处理其他连接；排在前面的响应等它生成后一起发送
+        if(client->NeedSql()) {
+            client->Hold();
+            sqlpool_->AddTask([this, reactor, client] { RunTask_(reactor, client, &WebServer::OnRespond_); });
+            return;
+        }
+        client->MakeResponse();
+    }
+    //完成模式：发送和继续接收由事件循环完成，把连接交回给它
+    if(ioUring_) {
+        HandBack_(reactor, client);
+        return;
     }
+    if(client->ToWriteBytes() > 0) {
+        OnWrite_(reactor, client);
+    }
+    else {
+        int fd = client->GetFd();
+        reactor->poller->ModFd(fd, connEvent_ | EPOLLIN, reactor->conns->Token(fd));
+    }
+}
+
+//生成响应，继续处理后面的请求，然后直接在当前线程发送，不再经过主线程的EPOLLOUT事件中转
+//只有发送缓冲区满(EAGAIN)时OnWrite_才注册EPOLLOUT，发送完且保持连接时直接重新注册EPOLLIN
+void WebServer::OnRespond_(Reactor* reactor, HttpConn* client) {
+    client->MakeResponse();
+    OnProcess(reactor, client);
 }
 
 //在子线程中执行写事件
-void WebServer::OnWrite_(HttpConn* client) {
+void WebServer::OnWrite_(Reactor* reactor, HttpConn* client) {
     assert(client);
     int ret = -1;
     int writeErrno = 0;
@@ -230,23 +492,191 @@ void WebServer::OnWrite_(HttpConn* client) {
     if(client->ToWriteBytes() == 0) {
         /* 传输完成 */
         if(client->IsKeepAlive()) {
-            OnProcess(client);
+            OnProcess(reactor, client);
             return;
         }
     }
     else if(ret < 0) {
         if(writeErrno == EAGAIN) {
             /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            reactor->poller->ModFd(client->GetFd(), connEvent_ | EPOLLOUT, reactor->conns->Token(client->GetFd()));
+            return;
+        }
+    }
+    CloseConn_(reactor, client);
+}
+
+//完成模式：收到了数据。请求还在处理或者响应还没发完时先暂存，之后再交给读缓冲区
+void WebServer::DealRecv_(Reactor* reactor, HttpConn* client, const char* buf, int len) {
+    assert(client && buf && len > 0);
+    ExtentTime_(reactor, client);
+    HttpConn::AsyncState& st = client->Async();
+    if(st.busy || st.sending || st.blocked) {
+        st.inbox.Append(buf, len);
+        //暂存的数据太多时暂停接收，不让请求体堆积在内存中，处理或发送完后再继续
+        if(st.inbox.ReadableBytes() >= HttpConn::READ_BUDGET && !st.paused) {
+            int fd = client->GetFd();
+            st.paused = true;
+            reactor->poller->ModFd(fd, 0, reactor->conns->Token(fd));
+        }
+        return;
+    }
+    client->Received(buf, len);
+    Process_(reactor, client);
+}
+
+//完成模式：Send完成，或者发送大文件时等到了可写
+void WebServer::DealSent_(Reactor* reactor, HttpConn* client, int res) {
+    assert(client);
+    HttpConn::AsyncState& st = client->Async();
+    ExtentTime_(reactor, client);
+    if(st.sending) {
+        st.sending = false;
+        //closeLinked：不保持连接的最后一次发送，fd已经由后端关闭
+        if(st.closeLinked || st.closing || res <= 0) {
+            CloseConn_(reactor, client);
+            return;
+        }
+        client->Sent(res);
+    }
+    else if(st.blocked) {
+        st.blocked = false;
+        if(st.closing || res < 0) {
+            CloseConn_(reactor, client);
+            return;
+        }
+    }
+    else {
+        return;
+    }
+    SendNext_(reactor, client);
+}
+
+//完成模式：读缓冲区中有了新数据，解析请求和生成响应交给线程池（多reactor模式下在本线程直接处理）
+void WebServer::Process_(Reactor* reactor, HttpConn* client) {
+    client->Async().busy = true;
+    client->Hold();
+    if(multiReactor_) {
+        RunTask_(reactor, client, &WebServer::OnProcess);
+        return;
+    }
+    reactor->tasks.emplace_back([this, reactor, client] { RunTask_(reactor, client, &WebServer::OnProcess); });
+}
+
+//完成模式：请求处理完，把连接交回事件循环；在其他线程时放进队列并唤醒事件循环
+void WebServer::HandBack_(Reactor* reactor, HttpConn* client) {
+    if(std::this_thread::get_id() == reactor->tid) {
+        Resume_(reactor, client);
+        return;
+    }
+    int fd = client->GetFd();
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> locker(reactor->readyMtx);
+        wake = reactor->ready.empty();
+        reactor->ready.emplace_back(fd, reactor->conns->Gen(fd));
+    }
+    //队列原来不为空时已经唤醒过，事件循环取走时会一起处理
+    if(wake) {
+        reactor->poller->Wake();
+    }
+}
+
+void WebServer::DrainReady_(Reactor* reactor) {
+    std::vector<std::pair<int, uint32_t>> ready;
+    {
+        std::lock_guard<std::mutex> locker(reactor->readyMtx);
+        if(reactor->ready.empty()) {
+            return;
+        }
+        ready.swap(reactor->ready);
+    }
+    for(auto& item: ready) {
+        HttpConn* client = reactor->conns->Get(item.first, item.second);
+        if(client) {
+            Resume_(reactor, client);
+        }
+    }
+}
+
+//完成模式：处理完请求回到事件循环，发送响应；没有完整的请求时继续接收
+void WebServer::Resume_(Reactor* reactor, HttpConn* client) {
+    HttpConn::AsyncState& st = client->Async();
+    st.busy = false;
+    if(st.closing) {
+        CloseConn_(reactor, client);
+        return;
+    }
+    if(client->ToWriteBytes() > 0) {
+        SendNext_(reactor, client);
+        return;
+    }
+    Feed_(reactor, client, false);
+}
+
+//完成模式：把暂存的数据交给读缓冲区，有新数据就处理，暂停了的接收重新开始
+//pending为true时读缓冲区中原有的数据（流水线中还没处理的请求）也要处理
+void WebServer::Feed_(Reactor* reactor, HttpConn* client, bool pending) {
+    HttpConn::AsyncState& st = client->Async();
+    bool fresh = st.inbox.ReadableBytes() > 0;
+    if(fresh) {
+        client->Received(st.inbox.Peek(), st.inbox.ReadableBytes());
+        st.inbox.RetrieveAll();
+    }
+    if(st.paused) {
+        int fd = client->GetFd();
+        st.paused = false;
+        reactor->poller->ModFd(fd, EPOLLIN, reactor->conns->Token(fd));
+    }
+    if(fresh || (pending && client->HasInput())) {
+        Process_(reactor, client);
+    }
+}
+
+//完成模式：发送队列中的响应头和缓存的文件交给后端异步发送，不保持连接时最后一次发送后由后端关闭fd
+//大文件在本线程用sendfile同步发送，发送缓冲区满时等待可写
+void WebServer::SendNext_(Reactor* reactor, HttpConn* client) {
+    HttpConn::AsyncState& st = client->Async();
+    int fd = client->GetFd();
+    while(client->ToWriteBytes() > 0) {
+        int flags = 0;
+        size_t len = 0;
+        const struct msghdr* msg = client->PrepareSend(&flags, &len);
+        if(msg) {
+            st.closeLinked = !client->IsKeepAlive() && len == client->ToWriteBytes();
+            st.sending = reactor->poller->Send(fd, msg, flags, st.closeLinked, reactor->conns->Token(fd));
+            if(!st.sending) {
+                st.closeLinked = false;
+                CloseConn_(reactor, client);
+            }
+            return;
+        }
+        int writeErrno = 0;
+        ssize_t ret = client->write(&writeErrno);
+        if(client->ToWriteBytes() == 0) {
+            break;
+        }
+        if(ret < 0 && writeErrno == EAGAIN) {
+            st.blocked = true;
+            reactor->poller->ModFd(fd, EPOLLOUT | (st.paused ? 0 : EPOLLIN), reactor->conns->Token(fd));
+            return;
+        }
+        if(ret <= 0) {
+            CloseConn_(reactor, client);
             return;
         }
     }
-    CloseConn_(client);
+    /* 传输完成 */
+    if(!client->IsKeepAlive()) {
+        CloseConn_(reactor, client);
+        return;
+    }
+    Feed_(reactor, client, true);
 }
 
 //初始化套接字
 /* Create listenFd */
-bool WebServer::InitSocket_() {
+bool WebServer::InitSocket_(Reactor* reactor) {
     int ret;
     struct sockaddr_in addr; //套接字地址
     if(port_ > 65535 || port_ < 1024) {
@@ -265,15 +695,15 @@ bool WebServer::InitSocket_() {
         optLinger.l_linger = 1;
     }
     //创建一个socket
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if(listenFd_ < 0) {
+    reactor->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if(reactor->listenFd < 0) {
         LOG_ERROR("Create socket error!", port_);
         return false;
     }
 
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+    ret = setsockopt(reactor->listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
     if(ret < 0) {
-        close(listenFd_);
+        close(reactor->listenFd);
         LOG_ERROR("Init linger error!", port_);
         return false;
     }
@@ -281,35 +711,44 @@ bool WebServer::InitSocket_() {
     int optval = 1;
     /* 端口复用 */
     /* 只有最后一个套接字会正常接收数据。 */
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
+    ret = setsockopt(reactor->listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
     if(ret == -1) {
         LOG_ERROR("set socket setsockopt error !");
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
+    /* 多reactor模式：每个reactor在同一端口上有独立的监听socket，由内核在它们之间分配新连接 */
+    if(multiReactor_) {
+        ret = setsockopt(reactor->listenFd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+        if(ret == -1) {
+            LOG_ERROR("set socket SO_REUSEPORT error !");
+            close(reactor->listenFd);
+            return false;
+        }
+    }
     //绑定socket
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
+    ret = bind(reactor->listenFd, (struct sockaddr *)&addr, sizeof(addr));
     if(ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
     //监听
-    ret = listen(listenFd_, 6);
+    ret = listen(reactor->listenFd, 6);
     if(ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
     //将监听的文件描述符添加到epoll管理
-    ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
+    ret = reactor->poller->AddListenFd(reactor->listenFd,  listenEvent_ | EPOLLIN);
     if(ret == 0) {
         LOG_ERROR("Add listen error!");
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
     //设置监听文件描述符为非阻塞
-    SetFdNonblock(listenFd_);
+    SetFdNonblock(reactor->listenFd);
     LOG_INFO("Server port:%d", port_);
     return true;
 }
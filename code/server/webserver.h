@@ -2,18 +2,23 @@
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
-#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <mutex>
 #include <fcntl.h>       // fcntl()
 #include <unistd.h>      // close()
 #include <assert.h>
 #include <errno.h>
+#include <signal.h>      // signal()
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 #include "epoller.h"
+#include "iouringpoller.h"
+#include "conntable.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
+#include "../timer/timewheel.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
 #include "../pool/sqlconnRAII.h"
@@ -21,33 +26,83 @@
 
 class WebServer {
 public:
+    //线程绑核策略
+    enum AFFINITY {
+        AFFINITY_NONE,     //不绑核，由内核调度
+        AFFINITY_PIN,      //reactor线程和工作线程各自绑定到一个核上
+        AFFINITY_ISOLATE,  //同上，且单reactor模式下reactor线程独占一个核，工作线程不使用该核
+    };
+
     WebServer(
         int port, int trigMode, int timeoutMS, bool OptLinger, 
         int sqlPort, const char* sqlUser, const  char* sqlPwd, 
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize,
+        bool multiReactor = false, bool ioUring = false, int affinity = AFFINITY_NONE,
+        size_t maxBodySize = HttpRequest::DEFAULT_MAX_BODY,
+        size_t sendfileThreshold = FileCache::DEFAULT_SENDFILE_THRESHOLD,
+        size_t maxUploadSize = HttpRequest::DEFAULT_MAX_UPLOAD);
+
 
     ~WebServer();
     void Start();
 
 private:
-    bool InitSocket_(); 
+    //一个reactor：拥有自己的监听socket、事件后端、定时器和连接表，以及由它accept的那部分连接
+    //单reactor模式只有一个，由主线程运行；多reactor模式每个线程一个
+    struct Reactor {
+        int listenFd = -1;
+        int cpu = -1;                   //绑定的核，-1表示不绑核
+        std::unique_ptr<Poller> poller; //epoll或io_uring
+        std::unique_ptr<TimeWheel> timer;
+        //按文件描述符下标保存本reactor的连接；由事件循环线程在绑核之后创建，槽位只被本reactor使用，
+        //多NUMA节点时连接对象和缓冲区都留在该线程所在的节点上，不会被其他节点的reactor复用
+        std::unique_ptr<ConnTable> conns;
+        std::vector<Task> tasks;        //本轮Wait收集到的读写任务，事件处理完后一次性交给线程池
+        std::thread::id tid;            //运行事件循环的线程，定时器只能由它操作
+        std::mutex closedMtx;
+        std::vector<std::pair<int, uint32_t>> closed; //其他线程关闭的连接（fd, 关闭后的代数），由事件循环取消定时器
+        std::mutex readyMtx;
+        std::vector<std::pair<int, uint32_t>> ready;  //完成模式：其他线程处理完请求的连接（fd, 代数），由事件循环接着发送
+    };
+
+    bool InitSocket_(Reactor* reactor); 
     void InitEventMode_(int trigMode);
-    void AddClient_(int fd, sockaddr_in addr);
+    std::unique_ptr<Poller> CreatePoller_();
+    static void LogResize_(const char* name, const ThreadPool::ResizeEvent& event);
+    void AddClient_(Reactor* reactor, int fd, sockaddr_in addr);
+    void Loop_(Reactor* reactor);
   
-    void DealListen_();
-    void DealWrite_(HttpConn* client);
-    void DealRead_(HttpConn* client);
+    void DealListen_(Reactor* reactor);
+    void DealWrite_(Reactor* reactor, HttpConn* client);
+    void DealRead_(Reactor* reactor, HttpConn* client);
 
     void SendError_(int fd, const char*info);
-    void ExtentTime_(HttpConn* client);
-    void CloseConn_(HttpConn* client);
+    void ExtentTime_(Reactor* reactor, HttpConn* client);
+    void OnTimeout_(Reactor* reactor, int fd, uint32_t gen);
+    void CloseConn_(Reactor* reactor, HttpConn* client);
+    void CancelClosed_(Reactor* reactor);
+
+    typedef void (WebServer::*Handler)(Reactor* reactor, HttpConn* client);
+    void RunTask_(Reactor* reactor, HttpConn* client, Handler handler);
+    void OnRead_(Reactor* reactor, HttpConn* client);
+    void OnWrite_(Reactor* reactor, HttpConn* client);
+    void OnProcess(Reactor* reactor, HttpConn* client);
+    void OnRespond_(Reactor* reactor, HttpConn* client);
 
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
-    void OnProcess(HttpConn* client);
+    //完成模式（io_uring）：读写由事件后端完成，线程池只解析请求和生成响应
+    void DealAccept_(Reactor* reactor, int fd);
+    void DealRecv_(Reactor* reactor, HttpConn* client, const char* buf, int len);
+    void DealSent_(Reactor* reactor, HttpConn* client, int res);
+    void Process_(Reactor* reactor, HttpConn* client);
+    void HandBack_(Reactor* reactor, HttpConn* client);
+    void DrainReady_(Reactor* reactor);
+    void Resume_(Reactor* reactor, HttpConn* client);
+    void Feed_(Reactor* reactor, HttpConn* client, bool pending);
+    void SendNext_(Reactor* reactor, HttpConn* client);
 
     static const int MAX_FD = 65536; //最大文件描述符数量
+    static const int POOL_IDLE_MS = 10000; //线程池中多出的线程空闲这么久后退出
 
     static int SetFdNonblock(int fd); //设置文件描述符非阻塞
 
@@ -55,16 +110,16 @@ private:
     bool openLinger_; //是否打开优雅关闭
     int timeoutMS_;  //超时时间 /* 毫秒MS */ 
     bool isClose_;  //是否关闭
-    int listenFd_;  //监听的文件描述符
+    bool multiReactor_; //是否为多reactor模式（每个线程一个epoll循环）
+    bool ioUring_; //事件后端是否为io_uring（完成模式），内核不支持时退回epoll
     char* srcDir_; //资源的目录
     
     uint32_t listenEvent_; //监听的文件描述符的事件
     uint32_t connEvent_;  //连接的文件描述符的事件
    
-    std::unique_ptr<HeapTimer> timer_;  //定时器
-    std::unique_ptr<ThreadPool> threadpool_;  //线程池
-    std::unique_ptr<Epoller> epoller_;  //epoll对象
-    std::unordered_map<int, HttpConn> users_; //用map保存客户端连接的信息，客户端信息封装在httpcpnn对象中，键是文件描述符
+    std::unique_ptr<ThreadPool> threadpool_;  //线程池，仅单reactor模式使用
+    std::unique_ptr<ThreadPool> sqlpool_;     //执行登录注册（查询数据库）的线程池，两种模式都使用，不占用处理静态文件的线程
+    std::vector<std::unique_ptr<Reactor>> reactors_; //所有reactor，下标0的由主线程运行
 };
 
 
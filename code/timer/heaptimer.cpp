@@ -2,12 +2,11 @@
 
 void HeapTimer::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());
-    size_t j = (i - 1) / 2;
-    while(j >= 0) {
+    while(i > 0) {
+        size_t j = (i - 1) / 2;
         if(heap_[j] < heap_[i]) { break; }
         SwapNode_(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 
@@ -91,8 +90,12 @@ void HeapTimer::del_(size_t index) {
  // 调整指定id的结点的超时时间
 void HeapTimer::adjust(int id, int timeout) {
     assert(!heap_.empty() && ref_.count(id) > 0);
-    heap_[ref_[id]].expires = Clock::now() + MS(timeout);;
-    siftdown_(ref_[id], heap_.size());
+    size_t i = ref_[id];
+    heap_[i].expires = Clock::now() + MS(timeout);
+    //超时时间可能变长也可能变短，没有下沉就向上检查
+    if(!siftdown_(i, heap_.size())) {
+        siftup_(i);
+    }
 }
 
  // 清除超时结点 
@@ -0,0 +1,183 @@
+#include "timewheel.h"
+
+TimeWheel::TimeWheel(): count_(0), start_(std::chrono::steady_clock::now()), now_(0), cur_(0) {
+    for(int i = 0; i < LEVELS * SLOTS; i++) {
+        heads_[i] = -1;
+    }
+    for(int i = 0; i < LEVELS; i++) {
+        bitmap_[i] = 0;
+    }
+}
+
+void TimeWheel::UpdateClock() {
+    now_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+}
+
+void TimeWheel::Insert_(int id) {
+    Node& node = nodes_[id];
+    assert(node.slot < 0 && node.expires >= cur_);
+    uint64_t delta = node.expires - cur_;
+    if(delta > MAX_TICKS) {
+        node.expires = cur_ + MAX_TICKS;
+        delta = MAX_TICKS;
+    }
+    //距离到期越远，放在越高的层
+    int level = 0;
+    while(level < LEVELS - 1 && delta >= (1ull << ((level + 1) * SLOT_BITS))) {
+        level++;
+    }
+    int idx = (node.expires >> (level * SLOT_BITS)) & (SLOTS - 1);
+    int slot = level * SLOTS + idx;
+    node.slot = slot;
+    node.prev = -1;
+    node.next = heads_[slot];
+    if(node.next >= 0) {
+        nodes_[node.next].prev = id;
+    }
+    heads_[slot] = id;
+    bitmap_[level] |= 1ull << idx;
+    count_++;
+}
+
+void TimeWheel::Unlink_(int id) {
+    Node& node = nodes_[id];
+    assert(node.slot >= 0);
+    if(node.prev >= 0) {
+        nodes_[node.prev].next = node.next;
+    }
+    else {
+        heads_[node.slot] = node.next;
+        if(node.next < 0) {
+            bitmap_[node.slot / SLOTS] &= ~(1ull << (node.slot % SLOTS));
+        }
+    }
+    if(node.next >= 0) {
+        nodes_[node.next].prev = node.prev;
+    }
+    node.prev = node.next = node.slot = -1;
+    count_--;
+}
+
+void TimeWheel::Cascade_(int level, uint64_t t) {
+    int slot = level * SLOTS + ((t >> (level * SLOT_BITS)) & (SLOTS - 1));
+    while(heads_[slot] >= 0) {
+        int id = heads_[slot];
+        Unlink_(id);
+        Insert_(id);
+    }
+}
+
+uint64_t TimeWheel::NextEvent_() const {
+    uint64_t next = 0;
+    for(int level = 0; level < LEVELS; level++) {
+        if(!bitmap_[level]) {
+            continue;
+        }
+        int shift = level * SLOT_BITS;
+        int pos = (cur_ >> shift) & (SLOTS - 1);
+        //从当前位置的下一个槽开始，找第一个不为空的槽
+        int r = (pos + 1) & (SLOTS - 1);
+        uint64_t rotated = r ? (bitmap_[level] >> r) | (bitmap_[level] << (SLOTS - r)) : bitmap_[level];
+        uint64_t steps = __builtin_ctzll(rotated) + 1;
+        //第0层的槽在对应时刻到期，高层的槽在对应的边界下放
+        uint64_t t = ((cur_ >> shift) + steps) << shift;
+        if(next == 0 || t < next) {
+            next = t;
+        }
+    }
+    return next;
+}
+
+void TimeWheel::add(int id, int timeout, const TimeoutCallBack& cb) {
+    assert(id >= 0);
+    if(static_cast<size_t>(id) >= nodes_.size()) {
+        nodes_.resize(std::max(static_cast<size_t>(id) + 1, nodes_.size() * 2));
+    }
+    Node& node = nodes_[id];
+    if(node.slot >= 0) {
+        Unlink_(id);
+    }
+    node.expires = now_ + (timeout > 0 ? timeout : 0);
+    if(node.expires <= cur_) {
+        node.expires = cur_ + 1;
+    }
+    node.cb = cb;
+    Insert_(id);
+}
+
+void TimeWheel::adjust(int id, int timeout) {
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) {
+        return;
+    }
+    Unlink_(id);
+    Node& node = nodes_[id];
+    node.expires = now_ + (timeout > 0 ? timeout : 0);
+    if(node.expires <= cur_) {
+        node.expires = cur_ + 1;
+    }
+    Insert_(id);
+}
+
+void TimeWheel::cancel(int id) {
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) {
+        return;
+    }
+    Unlink_(id);
+    nodes_[id].cb = nullptr;
+}
+
+void TimeWheel::doWork(int id) {
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) {
+        return;
+    }
+    Unlink_(id);
+    //回调中可能重新添加定时器，先把回调移出来
+    TimeoutCallBack cb = std::move(nodes_[id].cb);
+    nodes_[id].cb = nullptr;
+    cb();
+}
+
+void TimeWheel::clear() {
+    nodes_.clear();
+    for(int i = 0; i < LEVELS * SLOTS; i++) {
+        heads_[i] = -1;
+    }
+    for(int i = 0; i < LEVELS; i++) {
+        bitmap_[i] = 0;
+    }
+    count_ = 0;
+}
+
+void TimeWheel::tick() {
+    //只在有槽到期或需要下放的时刻停下，中间的空槽直接跳过
+    while(count_ > 0) {
+        uint64_t t = NextEvent_();
+        if(t > now_) {
+            break;
+        }
+        cur_ = t;
+        //先下放高层，高层下放到的槽可能正是低层这次要下放的槽
+        for(int level = LEVELS - 1; level > 0; level--) {
+            if((t & ((1ull << (level * SLOT_BITS)) - 1)) == 0) {
+                Cascade_(level, t);
+            }
+        }
+        int slot = t & (SLOTS - 1);
+        while(heads_[slot] >= 0) {
+            doWork(heads_[slot]);
+        }
+    }
+    //(cur_, now_]之间没有需要处理的时刻
+    if(cur_ < now_) {
+        cur_ = now_;
+    }
+}
+
+int TimeWheel::GetNextTick() {
+    tick();
+    if(count_ == 0) {
+        return -1;
+    }
+    return static_cast<int>(NextEvent_() - now_);
+}
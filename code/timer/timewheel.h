@@ -0,0 +1,73 @@
+#ifndef TIME_WHEEL_H
+#define TIME_WHEEL_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <assert.h>
+#include <chrono>
+#include <stdint.h>
+
+//分层时间轮定时器，接口与HeapTimer相同，添加、调整、删除都是O(1)
+//4层，每层64个槽，一格1毫秒：第0层覆盖64毫秒，第1层4.096秒，第2层约4.4分钟，第3层约4.6小时（更长的超时按上限处理）
+//第i层的槽在时间走到它对应的边界时整体下放到低层，第0层的槽到期即触发
+//定时器结点按id（文件描述符）下标保存，用下标串成每个槽的双向链表，不单独分配内存
+//时钟每轮事件循环只读一次：Wait返回后调用UpdateClock，之后的add/adjust都用这个时间
+class TimeWheel {
+public:
+    typedef std::function<void()> TimeoutCallBack;
+
+    TimeWheel();
+
+    ~TimeWheel() { clear(); }
+
+    void UpdateClock(); //读一次时钟，缓存为当前时间
+
+    void adjust(int id, int timeout); //id不在定时器中时什么也不做
+
+    void add(int id, int timeout, const TimeoutCallBack& cb);
+
+    void cancel(int id); //删除id的定时器，不触发回调
+
+    void doWork(int id); //触发id的回调并删除
+
+    void clear();
+
+    void tick(); //触发所有已到期的定时器
+
+    int GetNextTick(); //先tick，再返回距下一次需要处理的时间（毫秒），没有定时器时返回-1
+
+    size_t size() const { return count_; }
+
+    uint64_t Now() const { return now_; } //缓存的当前时间（毫秒），可作为连接的最后活跃时间
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const uint64_t MAX_TICKS = (1ull << (LEVELS * SLOT_BITS)) - 1;
+
+    struct Node {
+        int prev = -1;
+        int next = -1;
+        int slot = -1;       //所在的槽（层 * SLOTS + 下标），-1表示不在时间轮中
+        uint64_t expires = 0; //到期的时刻（毫秒）
+        TimeoutCallBack cb;
+    };
+
+    void Insert_(int id);  //按到期时间放入对应的层和槽
+    void Unlink_(int id);
+    void Cascade_(int level, uint64_t t); //把第level层中t对应的槽下放到低层
+    uint64_t NextEvent_() const; //cur_之后第一个有槽到期或需要下放的时刻，没有定时器时返回0
+
+    std::vector<Node> nodes_;       //下标为id
+    int heads_[LEVELS * SLOTS];     //每个槽的链表头
+    uint64_t bitmap_[LEVELS];       //每层哪些槽不为空
+    size_t count_;
+
+    std::chrono::steady_clock::time_point start_;
+    uint64_t now_;   //缓存的当前时间，start_之后的毫秒数
+    uint64_t cur_;   //已经处理到的时刻
+};
+
+#endif //TIME_WHEEL_H
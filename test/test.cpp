@@ -5,7 +5,21 @@
  */ 
 #include "../code/log/log.h"
 #include "../code/pool/threadpool.h"
+#include "../code/timer/timewheel.h"
+#include "../code/timer/heaptimer.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/httpscan.h"
+#include "../code/http/httpconn.h"
+#include "../code/http/urlencoded.h"
+#include "../code/http/filecache.h"
 #include <features.h>
+#include <chrono>
+#include <queue>
+#include <regex>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
 #include <sys/syscall.h>
@@ -50,7 +64,1226 @@ void TestThreadPool() {
     getchar();
 }
 
+//改造前的线程池：std::function + std::queue + 一把锁，作为基准
+class FunctionQueuePool {
+public:
+    explicit FunctionQueuePool(size_t threadCount): pool_(std::make_shared<Pool>()) {
+        for(size_t i = 0; i < threadCount; i++) {
+            std::thread([pool = pool_]{
+                std::unique_lock<std::mutex> locker(pool->mtx);
+                while(true) {
+                    if(!pool->tasks.empty()) {
+                        auto task = std::move(pool->tasks.front());
+                        pool->tasks.pop();
+                        locker.unlock();
+                        task();
+                        locker.lock();
+                    }
+                    else if(pool->isClosed) break;
+                    else pool->cond.wait(locker);
+                }
+            }).detach();
+        }
+    }
+    ~FunctionQueuePool() {
+        {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            pool_->isClosed = true;
+        }
+        pool_->cond.notify_all();
+    }
+    template<class F>
+    void AddTask(F&& task) {
+        {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            pool_->tasks.emplace(std::forward<F>(task));
+        }
+        pool_->cond.notify_one();
+    }
+private:
+    struct Pool {
+        std::mutex mtx;
+        std::condition_variable cond;
+        bool isClosed = false;
+        std::queue<std::function<void()>> tasks;
+    };
+    std::shared_ptr<Pool> pool_;
+};
+
+//模拟WebServer提交的任务：std::bind(&WebServer::OnRead_, this, reactor, client)
+struct BenchServer {
+    std::atomic<int> done{0};
+    void OnRead(void* reactor, void* client) { done++; }
+};
+
+template<class P>
+double BenchPool(P& pool, BenchServer& server, int n) {
+    server.done = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i++) {
+        pool.AddTask(std::bind(&BenchServer::OnRead, &server, &server, &pool));
+    }
+    while(server.done < n) {
+        std::this_thread::yield();
+    }
+    std::chrono::duration<double> cost = std::chrono::steady_clock::now() - start;
+    return n / cost.count();
+}
+
+//模拟事件循环：每轮Wait攒一批任务，一次提交
+double BenchPoolBatch(ThreadPool& pool, BenchServer& server, int n, int batch) {
+    server.done = 0;
+    std::vector<Task> tasks;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i += batch) {
+        for(int j = i; j < n && j < i + batch; j++) {
+            tasks.emplace_back(std::bind(&BenchServer::OnRead, &server, &server, &pool));
+        }
+        pool.AddTasks(tasks.begin(), tasks.end());
+        tasks.clear();
+    }
+    while(server.done < n) {
+        std::this_thread::yield();
+    }
+    std::chrono::duration<double> cost = std::chrono::steady_clock::now() - start;
+    return n / cost.count();
+}
+
+void TestThreadPoolBench() {
+    const int n = 1000000;
+    BenchServer server;
+    {
+        FunctionQueuePool pool(6);
+        printf("std::function + std::queue: %.0f tasks/s\n", BenchPool(pool, server, n));
+    }
+    {
+        ThreadPool pool(6, ThreadPool::SHARED_QUEUE);
+        printf("Task + TaskQueue:           %.0f tasks/s\n", BenchPool(pool, server, n));
+    }
+    {
+        ThreadPool pool(6, ThreadPool::WORK_STEALING);
+        printf("Work stealing:              %.0f tasks/s\n", BenchPool(pool, server, n));
+    }
+    {
+        ThreadPool pool(6, ThreadPool::SHARED_QUEUE);
+        printf("Task + TaskQueue, batch 64: %.0f tasks/s\n", BenchPoolBatch(pool, server, n, 64));
+    }
+    {
+        ThreadPool pool(6, ThreadPool::WORK_STEALING);
+        printf("Work stealing, batch 64:    %.0f tasks/s\n", BenchPoolBatch(pool, server, n, 64));
+    }
+}
+
+//弹性线程池：阻塞的任务让线程数增长到上限，空闲后回到下限，两种调度方式都检查
+void TestThreadPoolElastic(ThreadPool::MODE mode) {
+    ThreadPool pool(2, 8, 200, mode);
+    pool.SetResizeListener([](const ThreadPool::ResizeEvent& event) {
+        printf("%s: threads %zu, queued %zu, blocked %zu\n", ThreadPool::ReasonName(event.reason),
+               event.threads, event.queued, event.blocked);
+    });
+    std::atomic<int> done{0};
+    for(int i = 0; i < 16; i++) {
+        pool.AddTask([&done] {
+            ThreadPool::Blocking blocking;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            done++;
+        });
+    }
+    while(done < 16) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ThreadPool::Stats stats = pool.GetStats();
+    assert(stats.peak == 8);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    stats = pool.GetStats();
+    assert(stats.threads == 2 && stats.shrunk == 6);
+    printf("%s peak %zu, grown %zu, shrunk %zu\n", (mode == ThreadPool::WORK_STEALING ? "stealing" : "shared"),
+           stats.peak, stats.grown, stats.shrunk);
+}
+
+//时间轮：每个定时器都不早于到期时间触发，且不会晚太多；调整和删除后的定时器按新的设置处理
+void TestTimeWheel() {
+    const int n = 2000;
+    TimeWheel wheel;
+    std::vector<std::chrono::steady_clock::time_point> deadline(n), fired(n);
+    auto start = std::chrono::steady_clock::now();
+    wheel.UpdateClock();
+    for(int i = 0; i < n; i++) {
+        int timeout = rand() % 5000;
+        deadline[i] = start + std::chrono::milliseconds(timeout);
+        wheel.add(i, timeout, [&fired, i] { fired[i] = std::chrono::steady_clock::now(); });
+    }
+    //一半的定时器缩短，十分之一删除
+    for(int i = 0; i < n; i += 2) {
+        int timeout = rand() % 300;
+        deadline[i] = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        wheel.adjust(i, timeout);
+    }
+    for(int i = 1; i < n; i += 10) {
+        wheel.cancel(i);
+    }
+    while(true) {
+        int next = wheel.GetNextTick();
+        if(next < 0) { break; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(next));
+        wheel.UpdateClock();
+    }
+    int late = 0;
+    for(int i = 0; i < n; i++) {
+        if(i % 10 == 1) {
+            assert(fired[i] == std::chrono::steady_clock::time_point());
+            continue;
+        }
+        assert(fired[i] + std::chrono::milliseconds(1) >= deadline[i]);
+        late = std::max(late, static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            fired[i] - deadline[i]).count()));
+    }
+    printf("TimeWheel: max late %d ms\n", late);
+}
+
+//每次读写事件延长连接的超时时间：堆定时器adjust、时间轮adjust、只记录最后活跃时间
+void TestTimerBench() {
+    const int conns = 60000;
+    const int events = 5000000;
+    std::vector<int> fds(events);
+    for(int i = 0; i < events; i++) {
+        fds[i] = rand() % conns;
+    }
+    {
+        HeapTimer timer;
+        for(int fd = 0; fd < conns; fd++) {
+            timer.add(fd, 60000, [] {});
+        }
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < events; i++) {
+            timer.adjust(fds[i], 60000);
+        }
+        std::chrono::duration<double, std::nano> cost = std::chrono::steady_clock::now() - start;
+        printf("HeapTimer adjust:      %.1f ns/event\n", cost.count() / events);
+    }
+    {
+        TimeWheel timer;
+        timer.UpdateClock();
+        for(int fd = 0; fd < conns; fd++) {
+            timer.add(fd, 60000, [] {});
+        }
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < events; i++) {
+            if(i % 64 == 0) { timer.UpdateClock(); } //每轮事件循环读一次时钟
+            timer.adjust(fds[i], 60000);
+        }
+        std::chrono::duration<double, std::nano> cost = std::chrono::steady_clock::now() - start;
+        printf("TimeWheel adjust:      %.1f ns/event\n", cost.count() / events);
+    }
+    {
+        TimeWheel timer;
+        std::vector<uint64_t> lastActive(conns);
+        timer.UpdateClock();
+        for(int fd = 0; fd < conns; fd++) {
+            timer.add(fd, 60000, [] {});
+        }
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < events; i++) {
+            if(i % 64 == 0) { timer.UpdateClock(); }
+            lastActive[fds[i]] = timer.Now();
+        }
+        std::chrono::duration<double, std::nano> cost = std::chrono::steady_clock::now() - start;
+        printf("Last-activity touch:   %.1f ns/event\n", cost.count() / events);
+    }
+}
+
+//原来基于正则的解析：每行复制成string，每次调用都构造regex，作为对比的基准
+bool RegexParse(Buffer& buff, std::unordered_map<std::string, std::string>& header) {
+    const char CRLF[] = "\r\n";
+    int state = 0;
+    while(buff.ReadableBytes() && state != 2) {
+        const char* lineEnd = std::search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
+        std::string line(buff.Peek(), lineEnd);
+        if(state == 0) {
+            std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+            std::smatch subMatch;
+            if(!std::regex_match(line, subMatch, patten)) { return false; }
+            state = 1;
+        }
+        else {
+            std::regex patten("^([^:]*): ?(.*)$");
+            std::smatch subMatch;
+            if(std::regex_match(line, subMatch, patten)) { header[subMatch[1]] = subMatch[2]; }
+            else { state = 2; }
+        }
+        if(lineEnd == buff.BeginWrite()) { break; }
+        buff.RetrieveUntil(lineEnd + 2);
+    }
+    return true;
+}
+
+//解析一个典型的浏览器请求
+void TestParseBench() {
+    const std::string raw =
+        "GET /images/favicon.ico HTTP/1.1\r\n"
+        "Host: 127.0.0.1:1316\r\n"
+        "Connection: keep-alive\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+        "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+        "Referer: http://127.0.0.1:1316/\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+        "Cookie: session=8f2c0a9d7e6b5a4c3d2e1f0a9b8c7d6e; theme=dark; lang=zh-CN\r\n"
+        "\r\n";
+    const int n = 20000;
+    Buffer buff;
+    double regexCost, parseCost;
+    Log::Instance()->SetLevel(1); //与服务器默认的日志等级相同，不为每个请求写DEBUG日志
+    {
+        std::unordered_map<std::string, std::string> header;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n; i++) {
+            buff.Append(raw);
+            header.clear();
+            bool ok = RegexParse(buff, header);
+            assert(ok && header.size() == 8);
+            buff.RetrieveAll();
+        }
+        regexCost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+    }
+    {
+        HttpRequest request;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n * 10; i++) {
+            buff.Append(raw);
+            request.Init();
+            bool ok = request.parse(buff) == HttpRequest::GET_REQUEST;
+            assert(ok && request.IsKeepAlive() && request.GetHeader("host") == "127.0.0.1:1316");
+            buff.RetrieveAll();
+        }
+        parseCost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (n * 10);
+    }
+    printf("regex parse: %.0f ns/request, state machine parse: %.0f ns/request (%.0fx)\n",
+           regexCost, parseCost, regexCost / parseCost);
+}
+
+void TestParseIncremental() {
+    //两个流水线请求，逐字节送入解析器：头部不完整时不消耗数据，请求体收到多少取走多少，完整后只取走第一个请求
+    const std::string first =
+        "\r\n"
+        "POST /login HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: 25\r\n"
+        "\r\n"
+        "username=abc&password=123";
+    const std::string second = "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n";
+    const std::string raw = first + second;
+    Buffer buff;
+    HttpRequest request;
+    const size_t headSize = first.find("\r\n\r\n") + 4;
+    size_t i = 0;
+    for(; i < first.size(); i++) {
+        buff.Append(raw.data() + i, 1);
+        HttpRequest::HTTP_CODE ret = request.parse(buff);
+        if(i + 1 < first.size()) {
+            assert(ret == HttpRequest::NO_REQUEST && buff.ReadableBytes() == (i + 1 < headSize ? i + 1 : 0));
+        }
+        else {
+            assert(ret == HttpRequest::GET_REQUEST && buff.ReadableBytes() == 0);
+        }
+    }
+    assert(request.IsFinished() && request.method() == "POST" && request.path() == "/login.html");
+    assert(request.GetPost("username") == "abc" && request.GetPost("password") == "123");
+
+    buff.Append(raw.data() + i, raw.size() - i - 1);
+    request.Init();
+    assert(request.parse(buff) == HttpRequest::NO_REQUEST && !request.IsFinished());
+    buff.Append(raw.data() + raw.size() - 1, 1);
+    assert(request.parse(buff) == HttpRequest::GET_REQUEST && buff.ReadableBytes() == 0);
+    assert(request.method() == "GET" && request.path() == "/index.html" && !request.IsKeepAlive());
+
+    //格式错误和过长的头部
+    buff.Append("GET\r\n\r\n");
+    request.Init();
+    assert(request.parse(buff) == HttpRequest::BAD_REQUEST);
+    buff.RetrieveAll();
+    request.Init();
+    buff.Append("GET / HTTP/1.1\r\nX: " + std::string(HttpRequest::MAX_HEAD_SIZE, 'a'));
+    assert(request.parse(buff) == HttpRequest::BAD_REQUEST);
+    buff.RetrieveAll();
+    printf("incremental parse ok\n");
+}
+
+void TestParseHeaders() {
+    std::string raw = "GET / HTTP/1.1\r\nHOST: a.com\r\ncontent-TYPE: text/plain\r\nHost: b.com\r\n";
+    for(size_t i = 0; i < HttpRequest::INLINE_HEADERS + 8; i++) {
+        raw += "X-Extra-" + std::to_string(i) + ": " + std::to_string(i) + "\r\n";
+    }
+    raw += "If-None-Match: \"abc\"\r\nRange: bytes=0-9\r\n\r\n";
+    Buffer buff;
+    buff.Append(raw);
+    HttpRequest request;
+    assert(request.parse(buff) == HttpRequest::GET_REQUEST);
+    assert(request.HeaderCount() == HttpRequest::INLINE_HEADERS + 13);
+    //同名头部以第一个为准，常用头部按名字和按下标查到的结果相同
+    assert(request.GetHeader(HttpRequest::HOST) == "a.com" && request.GetHeader("host") == "a.com");
+    assert(request.GetHeader(HttpRequest::CONTENT_TYPE) == "text/plain");
+    assert(request.GetHeader(HttpRequest::IF_NONE_MATCH) == "\"abc\"" && request.GetHeader("RANGE") == "bytes=0-9");
+    assert(request.GetHeader(HttpRequest::CONNECTION).empty() && request.GetHeader("Accept-Encoding").empty());
+    assert(request.GetHeader("x-extra-0") == "0" && request.GetHeader("X-Extra-39") == "39");
+    assert(request.GetHeader("X-Extra-40").empty());
+    printf("header lookup ok\n");
+}
+
+//按Content-Length和分块编码确定请求体的结束位置，请求体边收边取走
+void TestParseBody() {
+    Buffer buff;
+    HttpRequest request;
+    //1MB的请求体分成64KB送入，读缓冲区中不会积累请求体
+    const std::string body(1 << 20, 'b');
+    buff.Append("POST /upload HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+    for(size_t off = 0; off < body.size(); off += 65536) {
+        buff.Append(body.data() + off, 65536);
+        HttpRequest::HTTP_CODE ret = request.parse(buff);
+        assert(ret == (off + 65536 < body.size() ? HttpRequest::NO_REQUEST : HttpRequest::GET_REQUEST));
+        assert(buff.ReadableBytes() == 0);
+    }
+    assert(request.body() == body && request.method() == "POST" && request.path() == "/upload");
+
+    //分块编码逐字节送入，带块扩展和尾部字段，后面紧跟下一个请求
+    const std::string chunked = "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                "5\r\nhello\r\n1;ext=1\r\n \r\nA\r\n0123456789\r\n0\r\nTrailer: x\r\n\r\n";
+    const std::string next = "GET / HTTP/1.1\r\n\r\n";
+    request.Init();
+    for(size_t i = 0; i < chunked.size(); i++) {
+        buff.Append(chunked.data() + i, 1);
+        HttpRequest::HTTP_CODE ret = request.parse(buff);
+        assert(ret == (i + 1 < chunked.size() ? HttpRequest::NO_REQUEST : HttpRequest::GET_REQUEST));
+    }
+    assert(request.body() == "hello 0123456789" && request.method() == "POST");
+    buff.Append(next);
+    request.Init();
+    assert(request.parse(buff) == HttpRequest::GET_REQUEST && request.path() == "/index.html");
+
+    //超过上限：在读入请求体之前拒绝
+    size_t maxBodySize = HttpRequest::maxBodySize;
+    HttpRequest::maxBodySize = 1000;
+    request.Init();
+    buff.Append("POST / HTTP/1.1\r\nContent-Length: 1001\r\n\r\n");
+    assert(request.parse(buff) == HttpRequest::ENTITY_TOO_LARGE);
+    buff.RetrieveAll();
+    request.Init();
+    buff.Append("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n200\r\n" + std::string(512, 'x') + "\r\n200\r\n");
+    assert(request.parse(buff) == HttpRequest::ENTITY_TOO_LARGE);
+    buff.RetrieveAll();
+    HttpRequest::maxBodySize = maxBodySize;
+
+    //格式错误
+    const char* bad[] = {
+        "POST / HTTP/1.1\r\nContent-Length: 12a\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 3\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabc\r\n",
+    };
+    for(const char* raw: bad) {
+        request.Init();
+        buff.Append(raw);
+        assert(request.parse(buff) == HttpRequest::BAD_REQUEST);
+        buff.RetrieveAll();
+    }
+
+    //从socket读：ET模式下一次read最多读READ_BUDGET左右，请求体在两次read之间被解析取走
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(ret == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    HttpConn::isET = true;
+    HttpConn conn;
+    sockaddr_in addr = { 0 };
+    conn.init(fds[0], addr);
+    std::string raw = "POST /upload HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    size_t sent = 0;
+    int capped = 0; //没有读到EAGAIN就停下的次数
+    bool done = false;
+    while(!done) {
+        ssize_t len = send(fds[1], raw.data() + sent, raw.size() - sent, 0);
+        if(len > 0) { sent += len; }
+        int readErrno = 0;
+        if(conn.read(&readErrno) > 0 && readErrno != EAGAIN) {
+            capped++;
+        }
+        done = conn.parse();
+    }
+    assert(sent == raw.size() && capped > 0);
+    conn.Close();
+    close(fds[1]);
+    printf("body framing ok\n");
+}
+
+//multipart上传：文件内容边收边写入临时文件，或交给回调
+void TestMultipart() {
+    std::string file(3 << 20, 0);
+    for(size_t i = 0; i < file.size(); i++) {
+        file[i] = "\r\n-ab"[rand() % 5]; //大量与分隔符相似的字节
+    }
+    const std::string boundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+    std::string body = "preamble\r\n--" + boundary + "\r\n"
+        "Content-Disposition: form-data; name=\"title\"\r\n\r\nhello; world\r\n--" + boundary + "\r\n"
+        "Content-Disposition: form-data; name=\"media\"; filename=\"a \\\"b\\\".bin\"\r\n"
+        "Content-Type: application/octet-stream\r\n\r\n" + file + "\r\n--" + boundary + "--\r\nepilogue";
+    std::string head = "POST /upload HTTP/1.1\r\nContent-Type: multipart/form-data; boundary=" + boundary +
+                       "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    //上传的文件不受maxBodySize限制，只受maxUploadSize限制
+    size_t maxBodySize = HttpRequest::maxBodySize;
+    size_t maxUploadSize = HttpRequest::maxUploadSize;
+    HttpRequest::maxBodySize = 4096;
+    HttpRequest::maxUploadSize = 64 << 20;
+
+    Buffer buff;
+    HttpRequest request;
+    std::string raw = head + body;
+    std::vector<HttpRequest::UploadFile> taken;
+    std::string path;
+    //第0轮写临时文件并取走，第1轮写临时文件不取走，第2轮交给回调
+    for(int round = 0; round < 3; round++) {
+        std::string received;
+        if(round == 2) {
+            HttpRequest::uploadCallback = [&received](const HttpRequest::UploadFile& f, const char* data, size_t len) {
+                assert(f.path.empty());
+                if(data) { received.append(data, len); }
+                return true;
+            };
+        }
+        request.Init();
+        HttpRequest::HTTP_CODE ret = HttpRequest::NO_REQUEST;
+        //每次送入的长度随机，分隔符会被切在任意位置
+        for(size_t off = 0; off < raw.size(); ) {
+            size_t n = std::min(raw.size() - off, static_cast<size_t>(1 + rand() % 70000));
+            buff.Append(raw.data() + off, n);
+            off += n;
+            ret = request.parse(buff);
+            assert(ret == (off < raw.size() ? HttpRequest::NO_REQUEST : HttpRequest::GET_REQUEST));
+            assert(buff.ReadableBytes() == 0);
+        }
+        assert(request.GetPost("title") == "hello; world");
+        assert(request.files().size() == 1);
+        const HttpRequest::UploadFile& f = request.files()[0];
+        assert(f.name == "media" && f.filename == "a \"b\".bin" && f.contentType == "application/octet-stream");
+        assert(f.size == file.size());
+        if(round < 2) {
+            std::ifstream in(f.path, std::ios::binary);
+            received.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        assert(received == file);
+        if(round == 0) {
+            taken = request.TakeFiles();
+            assert(taken.size() == 1 && request.files().empty());
+        }
+        else if(round == 1) {
+            path = f.path;
+        }
+    }
+    HttpRequest::uploadCallback = nullptr;
+    //取走的文件由调用者删除；没有取走的在下一个请求开始时删除
+    assert(access(taken[0].path.c_str(), F_OK) == 0);
+    unlink(taken[0].path.c_str());
+    assert(access(path.c_str(), F_OK) != 0);
+
+    //超过maxUploadSize时在读入请求体之前拒绝
+    HttpRequest::maxUploadSize = 1 << 20;
+    request.Init();
+    buff.Append(head);
+    assert(request.parse(buff) == HttpRequest::ENTITY_TOO_LARGE);
+    buff.RetrieveAll();
+
+    //通过HttpConn：生成响应时临时文件交给uploadHandler，之后连接关闭也不会删除
+    HttpRequest::maxUploadSize = 64 << 20;
+    taken.clear();
+    HttpConn::uploadHandler = [&taken](const HttpRequest& req, std::vector<HttpRequest::UploadFile>&& files) {
+        assert(req.GetPost("title") == "hello; world");
+        taken = std::move(files);
+    };
+    const char* srcDir = HttpConn::srcDir;
+    HttpConn::srcDir = "/tmp/";
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(ret == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    HttpConn conn;
+    sockaddr_in addr = { 0 };
+    conn.init(fds[0], addr);
+    std::thread sender([&raw, &fds] {
+        for(size_t off = 0; off < raw.size(); ) {
+            ssize_t len = send(fds[1], raw.data() + off, raw.size() - off, 0);
+            assert(len > 0);
+            off += len;
+        }
+    });
+    bool done = false;
+    while(!done) {
+        int readErrno = 0;
+        conn.read(&readErrno);
+        done = conn.parse();
+    }
+    sender.join();
+    conn.MakeResponse();
+    conn.Close();
+    close(fds[1]);
+    HttpConn::uploadHandler = nullptr;
+    HttpConn::srcDir = srcDir;
+    assert(taken.size() == 1 && taken[0].size == file.size());
+    assert(access(taken[0].path.c_str(), F_OK) == 0);
+    unlink(taken[0].path.c_str());
+
+    //缺少结束分隔符
+    body = "--" + boundary + "\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\nvalue";
+    buff.Append("POST / HTTP/1.1\r\nContent-Type: multipart/form-data; boundary=\"" + boundary + "\"\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+    request.Init();
+    assert(request.parse(buff) == HttpRequest::BAD_REQUEST);
+    buff.RetrieveAll();
+    HttpRequest::maxBodySize = maxBodySize;
+    HttpRequest::maxUploadSize = maxUploadSize;
+    printf("multipart upload ok\n");
+}
+
+//urlencoded表单就地解码，再比较大表单的解析速度
+void TestUrlEncoded() {
+    std::string form = "title=a+b%20c&sub%5B%5D=1&sub%5b%5d=2&&empty=&noeq&eq=x=y&bad=%zz%4&%e4%b8%ad=%E6%96%87";
+    std::vector<UrlEncoded::Field> fields;
+    UrlEncoded::Parse(&form[0], &form[0] + form.size(), fields);
+    const std::pair<const char*, const char*> expect[] = {
+        { "title", "a b c" }, { "sub[]", "1" }, { "sub[]", "2" }, { "empty", "" }, { "noeq", "" },
+        { "eq", "x=y" }, { "bad", "%zz%4" }, { "\xe4\xb8\xad", "\xe6\x96\x87" },
+    };
+    assert(fields.size() == sizeof(expect) / sizeof(expect[0]));
+    for(size_t i = 0; i < fields.size(); i++) {
+        assert(fields[i].first == expect[i].first && fields[i].second == expect[i].second);
+    }
+    std::string text = "100%25+%3D%26 done%";
+    text.resize(UrlEncoded::Decode(&text[0], &text[0] + text.size()) - text.data());
+    assert(text == "100% =& done%");
+
+    //1MB的表单：大部分是不需要解码的字节
+    std::string big;
+    while(big.size() < (1 << 20)) {
+        big += "filter" + std::to_string(big.size()) + "=" + std::string(100, 'v') + "%2C" + std::string(50, 'w') + "&";
+    }
+    const HttpScan::LEVEL levels[] = { HttpScan::SCALAR, HttpScan::SSE42, HttpScan::AVX2 };
+    std::string work;
+    for(HttpScan::LEVEL level: levels) {
+        if(!HttpScan::SetLevel(level)) { continue; }
+        const int n = 200;
+        double cost = 0;
+        for(int i = 0; i < n; i++) {
+            work = big;
+            fields.clear();
+            auto start = std::chrono::steady_clock::now();
+            UrlEncoded::Parse(&work[0], &work[0] + work.size(), fields);
+            cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            assert(fields.back().second.size() == 151);
+        }
+        printf("urlencoded %zu bytes, %-6s: %.2f GB/s\n", big.size(), HttpScan::LevelName(level), big.size() * n / cost);
+    }
+    HttpScan::SetLevel(HttpScan::Supported(HttpScan::AVX2) ? HttpScan::AVX2 :
+                       HttpScan::Supported(HttpScan::SSE42) ? HttpScan::SSE42 : HttpScan::SCALAR);
+
+    //登录表单
+    Buffer buff;
+    HttpRequest request;
+    std::string body = "username=%E5%BC%A0%E4%B8%89&password=p%40ss+word";
+    buff.Append("POST /login HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\n\r\n" + body);
+    assert(request.parse(buff) == HttpRequest::GET_REQUEST);
+    assert(request.GetPost("username") == "\xe5\xbc\xa0\xe4\xb8\x89" && request.GetPostView("password") == "p@ss word");
+
+    //字段很多的表单经过HttpRequest::parse：耗时应与字段数成线性，同名字段以最后一个为准
+    const int count = 40000;
+    body.clear();
+    for(int i = 0; i < count; i++) {
+        body += "f" + std::to_string(i) + "=" + std::to_string(i) + "&dup=" + std::to_string(i) + "&";
+    }
+    buff.RetrieveAll();
+    buff.Append("POST /form HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\n\r\n" + body);
+    request.Init();
+    auto start = std::chrono::steady_clock::now();
+    assert(request.parse(buff) == HttpRequest::GET_REQUEST);
+    std::chrono::duration<double, std::milli> cost = std::chrono::steady_clock::now() - start;
+    assert(request.GetPostView("f0") == "0" && request.GetPostView("f39999") == "39999");
+    assert(request.GetPostView("dup") == std::to_string(count - 1) && request.GetPostView("missing").empty());
+    printf("parse %d form fields (%zu bytes): %.2f ms\n", count * 2, body.size(), cost.count());
+    assert(cost.count() < 500);
+    printf("urlencoded ok\n");
+}
+
+//各个向量实现与逐字节实现的结果逐一对比，再比较大头部请求的解析速度
+void TestHttpScan() {
+    const HttpScan::LEVEL levels[] = { HttpScan::SCALAR, HttpScan::SSE42, HttpScan::AVX2 };
+    const char alphabet[] = "aZ09-_:; \t\r\n\x7f\x01\x80\xff%+&=";
+    std::vector<char> data(300);
+    for(int round = 0; round < 2000; round++) {
+        for(char& ch: data) {
+            ch = rand() % 4 ? 'a' + rand() % 26 : alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        const char* begin = data.data() + rand() % 40;
+        const char* end = begin + rand() % (data.data() + data.size() - begin + 1);
+        HttpScan::SetLevel(HttpScan::SCALAR);
+        const char* crlf = HttpScan::FindCRLF(begin, end);
+        const char* token = HttpScan::SkipToken(begin, end);
+        const char* ctl = HttpScan::FindSpaceOrCtl(begin, end);
+        const char* form = HttpScan::FindFormDelim(begin, end);
+        for(HttpScan::LEVEL level: levels) {
+            if(!HttpScan::SetLevel(level)) { continue; }
+            assert(HttpScan::FindCRLF(begin, end) == crlf);
+            assert(HttpScan::SkipToken(begin, end) == token);
+            assert(HttpScan::FindSpaceOrCtl(begin, end) == ctl);
+            assert(HttpScan::FindFormDelim(begin, end) == form);
+        }
+    }
+
+    std::string raw = "GET /api/v1/items?page=2&size=50 HTTP/1.1\r\n";
+    for(int i = 0; i < 30; i++) {
+        raw += "X-Forwarded-Custom-Header-" + std::to_string(i) + ": value-" + std::string(40, 'v') + "\r\n";
+    }
+    raw += "Cookie: " + std::string(4096, 'c') + "\r\n\r\n";
+    const int n = 100000;
+    Buffer buff;
+    HttpRequest request;
+    for(HttpScan::LEVEL level: levels) {
+        if(!HttpScan::SetLevel(level)) { continue; }
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n; i++) {
+            buff.Append(raw);
+            request.Init();
+            bool ok = request.parse(buff) == HttpRequest::GET_REQUEST;
+            assert(ok && request.GetHeader("cookie").size() == 4096);
+            buff.RetrieveAll();
+        }
+        std::chrono::duration<double, std::nano> cost = std::chrono::steady_clock::now() - start;
+        printf("parse %zu byte request, %-6s: %.0f ns/request, %.2f GB/s\n", raw.size(), HttpScan::LevelName(level),
+               cost.count() / n, raw.size() * n / cost.count());
+    }
+    HttpScan::SetLevel(HttpScan::Supported(HttpScan::AVX2) ? HttpScan::AVX2 :
+                       HttpScan::Supported(HttpScan::SSE42) ? HttpScan::SSE42 : HttpScan::SCALAR);
+}
+
+//文件缓存：命中、规范化路径、inotify失效、LRU淘汰，以及命中与每次stat+open+mmap的耗时对比
+void TestFileCache() {
+    char dir[] = "/tmp/webserver_cacheXXXXXX";
+    assert(mkdtemp(dir));
+    std::string srcDir = std::string(dir) + "/";
+    mkdir((srcDir + "css").c_str(), 0755);
+    auto writeFile = [&](const std::string& name, const std::string& content) {
+        std::ofstream out(srcDir + name, std::ios::trunc);
+        out << content;
+    };
+    writeFile("index.html", "hello");
+    writeFile("css/a.css", "a {}");
+    FileCache* cache = FileCache::Instance();
+    cache->Clear();
+
+    FileCache::EntryPtr index = cache->Get(srcDir, "/index.html");
+    assert(index && index->size == 5 && memcmp(index->data, "hello", 5) == 0 && index->type == "text/html");
+    assert(cache->Get(srcDir, "/index.html") == index);
+    assert(cache->Get(srcDir, "//./index.html") == index);
+    assert(!cache->Get(srcDir, "/../index.html") && !cache->Get(srcDir, "/css/../index.html"));
+    assert(!cache->Get(srcDir, "/missing.html"));
+    FileCache::EntryPtr css = cache->Get(srcDir, "/css");
+    assert(css && S_ISDIR(css->mode) && css->size == 0);
+
+    //等待监视线程处理事件
+    auto waitChange = [&](const std::string& path, const FileCache::EntryPtr& old) {
+        for(int i = 0; i < 200; i++) {
+            if(cache->Get(srcDir, path) != old) { return true; }
+            usleep(5000);
+        }
+        return false;
+    };
+    if(cache->IsWatched(srcDir)) {
+        //用rename整体替换：被替换的条目在最后一个使用者释放之前仍然是原来的内容
+        FileCache::EntryPtr a = cache->Get(srcDir, "/css/a.css");
+        writeFile("css/a.css.tmp", "a { color: red }");
+        rename((srcDir + "css/a.css.tmp").c_str(), (srcDir + "css/a.css").c_str());
+        assert(waitChange("/css/a.css", a));
+        assert(cache->Get(srcDir, "/css/a.css")->size == 16);
+        assert(memcmp(a->data, "a {}", 4) == 0);
+        writeFile("index.html", "hello world");
+        assert(waitChange("/index.html", index));
+        assert(cache->Get(srcDir, "/index.html")->size == 11);
+        a = cache->Get(srcDir, "/css/a.css");
+        unlink((srcDir + "css/a.css").c_str());
+        assert(waitChange("/css/a.css", a));
+        assert(!cache->Get(srcDir, "/css/a.css"));
+    }
+
+    //条目数上限为2：第三个文件淘汰最久没用的
+    writeFile("1.txt", "1");
+    writeFile("2.txt", "22");
+    cache->Clear();
+    cache->SetLimit(2, FileCache::DEFAULT_MAX_BYTES);
+    FileCache::EntryPtr one = cache->Get(srcDir, "/1.txt");
+    cache->Get(srcDir, "/2.txt");
+    cache->Get(srcDir, "/1.txt");
+    cache->Get(srcDir, "/index.html");
+    assert(cache->Count() == 2 && cache->Get(srcDir, "/1.txt") == one);
+    assert(cache->Bytes() == 1 + cache->Get(srcDir, "/index.html")->size);
+    //超过上限四分之一的文件不缓存
+    cache->SetLimit(FileCache::DEFAULT_MAX_ENTRIES, 8);
+    FileCache::EntryPtr big = cache->Get(srcDir, "/index.html");
+    assert(cache->Count() == 0 && big && big != cache->Get(srcDir, "/index.html") && cache->Count() == 0);
+    cache->SetLimit(FileCache::DEFAULT_MAX_ENTRIES, FileCache::DEFAULT_MAX_BYTES);
+
+    //多个线程同时未命中（文件在锁外加载），期间不断清空缓存：每次都拿到完整的条目，同一路径最终只缓存一份
+    {
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> readers;
+        for(int t = 0; t < 4; t++) {
+            readers.emplace_back([&] {
+                const std::pair<const char*, size_t> files[] = { { "/1.txt", 1 }, { "/2.txt", 2 }, { "/index.html", 0 } };
+                while(!stop) {
+                    for(auto& f: files) {
+                        FileCache::EntryPtr entry = cache->Get(srcDir, f.first);
+                        assert(entry && entry->data && (f.second == 0 || entry->size == f.second));
+                    }
+                }
+            });
+        }
+        for(int i = 0; i < 200; i++) {
+            cache->Clear();
+            usleep(100);
+        }
+        stop = true;
+        for(auto& t: readers) { t.join(); }
+        FileCache::EntryPtr entry = cache->Get(srcDir, "/2.txt");
+        assert(cache->Get(srcDir, "/2.txt") == entry && cache->Count() <= 3);
+    }
+
+    const int n = 200000;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i++) {
+        FileCache::EntryPtr entry = cache->Get(srcDir, "/index.html");
+        assert(entry->data);
+    }
+    std::chrono::duration<double, std::nano> hit = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i++) {
+        struct stat st;
+        stat((srcDir + "/index.html").c_str(), &st);
+        int fd = open((srcDir + "/index.html").c_str(), O_RDONLY);
+        void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        assert(data != MAP_FAILED);
+        munmap(data, st.st_size);
+    }
+    std::chrono::duration<double, std::nano> syscall = std::chrono::steady_clock::now() - start;
+    printf("file cache hit: %.0f ns/request, stat+open+mmap+munmap: %.0f ns/request\n",
+           hit.count() / n, syscall.count() / n);
+
+    cache->Clear();
+    for(const char* name: { "index.html", "1.txt", "2.txt" }) {
+        unlink((srcDir + name).c_str());
+    }
+    rmdir((srcDir + "css").c_str());
+    rmdir(dir);
+}
+
+//小文件和错误页面的完整响应只生成一次，之后每次都是同一块内存
+void TestResponseCache() {
+    char dir[] = "/tmp/webserver_respXXXXXX";
+    assert(mkdtemp(dir));
+    std::string srcDir = std::string(dir) + "/";
+    {
+        std::ofstream small(srcDir + "index.html");
+        small << "hello";
+        std::ofstream big(srcDir + "big.txt");
+        big << std::string(HttpResponse::SMALL_RESPONSE + 1, 'b');
+    }
+    auto make = [&](std::string path, bool keepAlive, int code, Buffer& buff) {
+        HttpResponse* response = new HttpResponse;
+        response->Init(srcDir, path, keepAlive, code);
+        response->MakeResponse(buff);
+        return std::unique_ptr<HttpResponse>(response);
+    };
+    Buffer buff;
+    auto first = make("/index.html", true, 200, buff);
+    assert(buff.ReadableBytes() == 0);
+    std::string full(first->File(), first->FileLen());
+    assert(full.find("HTTP/1.1 200 OK\r\nConnection: keep-alive\r\n") == 0);
+    assert(full.size() > 5 && full.compare(full.size() - 9, 9, "\r\n\r\nhello") == 0);
+    auto second = make("/index.html", true, 200, buff);
+    assert(second->File() == first->File() && buff.ReadableBytes() == 0);
+    auto closed = make("/index.html", false, 200, buff);
+    assert(closed->File() != first->File());
+    assert(std::string(closed->File(), closed->FileLen()).find("Connection: close\r\n") != std::string::npos);
+
+    //错误页面不存在：预先生成的错误信息
+    auto missing = make("/missing", true, 200, buff);
+    std::string notFound(missing->File(), missing->FileLen());
+    assert(notFound.find("HTTP/1.1 404 Not Found\r\n") == 0 && notFound.find("File NotFound!") != std::string::npos);
+    assert(make("/other", true, 200, buff)->File() == missing->File() && buff.ReadableBytes() == 0);
+    assert(std::string(make("", false, 400, buff)->File()).find("HTTP/1.1 400 Bad Request\r\nConnection: close") == 0);
+
+    //大文件：响应头在写缓冲区，文件单独发送
+    auto big = make("/big.txt", true, 200, buff);
+    assert(buff.ReadableBytes() > 0 && big->FileLen() == HttpResponse::SMALL_RESPONSE + 1);
+    buff.RetrieveAll();
+
+    //文件改动后重新生成
+    if(FileCache::Instance()->IsWatched(srcDir)) {
+        {
+            std::ofstream small(srcDir + "index.tmp");
+            small << "changed";
+        }
+        rename((srcDir + "index.tmp").c_str(), (srcDir + "index.html").c_str());
+        std::string changed;
+        for(int i = 0; i < 200 && changed.find("changed") == std::string::npos; i++) {
+            usleep(5000);
+            auto response = make("/index.html", true, 200, buff);
+            changed.assign(response->File(), response->FileLen());
+        }
+        assert(changed.find("\r\n\r\nchanged") != std::string::npos);
+        assert(full.compare(full.size() - 5, 5, first->File() + full.size() - 5, 5) == 0);
+    }
+
+    const int n = 200000;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i++) {
+        std::string path = "/index.html";
+        HttpResponse response;
+        response.Init(srcDir, path, true, 200);
+        response.MakeResponse(buff);
+    }
+    std::chrono::duration<double, std::nano> cost = std::chrono::steady_clock::now() - start;
+    printf("cached response: %.0f ns/response\n", cost.count() / n);
+
+    first.reset(); second.reset(); closed.reset(); big.reset();
+    FileCache::Instance()->Clear();
+    unlink((srcDir + "index.html").c_str());
+    unlink((srcDir + "big.txt").c_str());
+    rmdir(dir);
+}
+
+//发送连接上的全部响应，另一个线程从对端读取，返回对端收到的字节数；out为空时丢弃收到的内容
+static size_t SendAll(HttpConn& conn, int peer, size_t expect, std::string* out) {
+    size_t received = 0;
+    std::thread reader([&] {
+        char buf[65536];
+        while(received < expect) {
+            ssize_t n = ::read(peer, buf, sizeof(buf));
+            if(n > 0) {
+                received += n;
+                if(out) { out->append(buf, n); }
+            }
+            else if(n < 0 && errno == EAGAIN) { struct pollfd pfd = { peer, POLLIN, 0 }; poll(&pfd, 1, 100); }
+            else { break; }
+        }
+    });
+    int err = 0;
+    while(conn.ToWriteBytes() > 0) {
+        if(conn.write(&err) < 0) {
+            assert(err == EAGAIN);
+            struct pollfd pfd = { conn.GetFd(), POLLOUT, 0 };
+            poll(&pfd, 1, 100);
+        }
+    }
+    reader.join();
+    return received;
+}
+
+//超过阈值的文件不映射，用sendfile分块发送；与每次映射整个文件对比
+void TestSendfile() {
+    char dir[] = "/tmp/webserver_sendfileXXXXXX";
+    assert(mkdtemp(dir));
+    std::string srcDir = std::string(dir) + "/";
+    std::string video(24 << 20, 0);
+    for(size_t i = 0; i < video.size(); i++) { video[i] = static_cast<char>(i * 131 >> 7); }
+    {
+        std::ofstream big(srcDir + "video.mp4");
+        big << video;
+        std::ofstream small(srcDir + "index.html");
+        small << "hello";
+    }
+    FileCache* cache = FileCache::Instance();
+    cache->SetSendfileThreshold(1 << 20);
+    FileCache::EntryPtr entry = cache->Get(srcDir, "/video.mp4");
+    assert(entry && entry->fd >= 0 && !entry->data && entry->size == video.size() && cache->Bytes() == 0);
+    entry.reset();
+
+    HttpConn::srcDir = srcDir.c_str();
+    HttpConn::isET = true;
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(ret == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    HttpConn conn;
+    sockaddr_in addr = { 0 };
+    conn.init(fds[0], addr);
+
+    //小文件、大文件、小文件排在同一个发送队列中，按顺序发送
+    const std::string small = "GET /index.html HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    const std::string big = "GET /video.mp4 HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    std::string requests = small + big + small;
+    ssize_t n = ::write(fds[1], requests.data(), requests.size());
+    assert(n == static_cast<ssize_t>(requests.size()));
+    int err = 0;
+    conn.read(&err);
+    while(conn.CanPipeline() && conn.parse()) {
+        conn.MakeResponse();
+    }
+    std::string out;
+    SendAll(conn, fds[1], conn.ToWriteBytes(), &out);
+    size_t first = out.find("hello");
+    size_t head = out.find("HTTP/1.1 200 OK", first);
+    size_t body = out.find("\r\n\r\n", head) + 4;
+    assert(first != std::string::npos && head == first + 5);
+    assert(out.find("Content-length: " + std::to_string(video.size()) + "\r\n", head) < body);
+    assert(out.compare(body, video.size(), video) == 0);
+    assert(out.compare(body + video.size(), 15, "HTTP/1.1 200 OK") == 0 && out.compare(out.size() - 5, 5, "hello") == 0);
+
+    //同一个24MB文件：sendfile分块发送，对比每次映射整个文件后writev
+    for(size_t threshold: { static_cast<size_t>(1 << 20), static_cast<size_t>(1) << 40 }) {
+        cache->SetSendfileThreshold(threshold);
+        const int rounds = 10;
+        struct rusage before, after;
+        getrusage(RUSAGE_SELF, &before);
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < rounds; i++) {
+            n = ::write(fds[1], big.data(), big.size());
+            conn.read(&err);
+            conn.parse();
+            conn.MakeResponse();
+            size_t received = SendAll(conn, fds[1], conn.ToWriteBytes(), nullptr);
+            assert(received > video.size());
+        }
+        std::chrono::duration<double> cost = std::chrono::steady_clock::now() - start;
+        getrusage(RUSAGE_SELF, &after);
+        printf("%-11s %zu MB: %.2f GB/s, %ld page faults/response\n", threshold == (1 << 20) ? "sendfile" : "mmap+writev",
+               video.size() >> 20, video.size() * rounds / cost.count() / 1e9, (after.ru_minflt - before.ru_minflt) / rounds);
+    }
+    cache->SetSendfileThreshold(FileCache::DEFAULT_SENDFILE_THRESHOLD);
+
+    conn.Close();
+    close(fds[1]);
+    unlink((srcDir + "video.mp4").c_str());
+    unlink((srcDir + "index.html").c_str());
+    rmdir(dir);
+}
+
+//按范围请求：单个范围、后缀、多个范围、不能满足、语法错误和If-Range，映射的文件和sendfile的文件都要只发送请求的部分
+void TestRange() {
+    char dir[] = "/tmp/webserver_rangeXXXXXX";
+    assert(mkdtemp(dir));
+    std::string srcDir = std::string(dir) + "/";
+    std::string text = "0123456789abcdefghij";
+    std::string video(3 << 20, 0);
+    for(size_t i = 0; i < video.size(); i++) { video[i] = static_cast<char>(i * 131 >> 7); }
+    {
+        std::ofstream small(srcDir + "a.txt");
+        small << text;
+        std::ofstream big(srcDir + "video.mp4");
+        big << video;
+    }
+    FileCache::Instance()->SetSendfileThreshold(1 << 20);
+    HttpConn::srcDir = srcDir.c_str();
+    HttpConn::isET = true;
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(ret == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    HttpConn conn;
+    sockaddr_in addr = { 0 };
+    conn.init(fds[0], addr);
+
+    //返回响应头和正文
+    auto get = [&](const std::string& path, const std::string& headers) {
+        std::string request = "GET " + path + " HTTP/1.1\r\nConnection: keep-alive\r\n" + headers + "\r\n";
+        ssize_t n = ::write(fds[1], request.data(), request.size());
+        assert(n == static_cast<ssize_t>(request.size()));
+        int err = 0;
+        conn.read(&err);
+        bool parsed = conn.parse();
+        assert(parsed);
+        conn.MakeResponse();
+        std::string out;
+        SendAll(conn, fds[1], conn.ToWriteBytes(), &out);
+        size_t end = out.find("\r\n\r\n") + 4;
+        return std::make_pair(out.substr(0, end), out.substr(end));
+    };
+    auto full = get("/a.txt", "");
+    assert(full.first.find("HTTP/1.1 200 OK\r\n") == 0 && full.second == text);
+    assert(full.first.find("Accept-Ranges: bytes\r\n") != std::string::npos);
+    size_t pos = full.first.find("ETag: ");
+    std::string etag = full.first.substr(pos + 6, full.first.find("\r\n", pos) - pos - 6);
+    pos = full.first.find("Last-Modified: ");
+    std::string modified = full.first.substr(pos + 15, full.first.find("\r\n", pos) - pos - 15);
+    assert(etag.size() > 2 && etag[0] == '"' && modified.find(" GMT") != std::string::npos);
+
+    auto part = get("/a.txt", "Range: bytes=2-5\r\n");
+    assert(part.first.find("HTTP/1.1 206 Partial Content\r\n") == 0 && part.second == "2345");
+    assert(part.first.find("Content-Range: bytes 2-5/20\r\n") != std::string::npos);
+    assert(get("/a.txt", "Range: bytes=-3\r\n").second == "hij");
+    assert(get("/a.txt", "Range: bytes=15-100\r\n").second == "fghij");
+    assert(get("/a.txt", "Range: BYTES= 18- \r\n").second == "ij");
+
+    //多个范围：multipart/byteranges，每一段带自己的Content-Range
+    auto multi = get("/a.txt", "Range: bytes=0-1, 10-12,-1\r\n");
+    pos = multi.first.find("multipart/byteranges; boundary=");
+    assert(multi.first.find("HTTP/1.1 206") == 0 && pos != std::string::npos);
+    std::string boundary = multi.first.substr(pos + 31, multi.first.find("\r\n", pos) - pos - 31);
+    std::string expect = "--" + boundary + "\r\nContent-Type: text/plain\r\nContent-Range: bytes 0-1/20\r\n\r\n01"
+                         "\r\n--" + boundary + "\r\nContent-Type: text/plain\r\nContent-Range: bytes 10-12/20\r\n\r\nabc"
+                         "\r\n--" + boundary + "\r\nContent-Type: text/plain\r\nContent-Range: bytes 19-19/20\r\n\r\nj"
+                         "\r\n--" + boundary + "--\r\n";
+    assert(multi.second == expect);
+    assert(multi.first.find("Content-length: " + std::to_string(expect.size()) + "\r\n") != std::string::npos);
+
+    //不能满足：416；语法错误或范围太多：忽略Range
+    auto unsatisfiable = get("/a.txt", "Range: bytes=20-\r\n");
+    assert(unsatisfiable.first.find("HTTP/1.1 416 Range Not Satisfiable\r\n") == 0);
+    assert(unsatisfiable.first.find("Content-Range: bytes */20\r\n") != std::string::npos);
+    assert(unsatisfiable.first.find("Content-type: text/html\r\n") != std::string::npos);
+    auto unsatisfiableVideo = get("/video.mp4", "Range: bytes=99999999-\r\n");
+    assert(unsatisfiableVideo.first.find("HTTP/1.1 416") == 0);
+    assert(unsatisfiableVideo.first.find("Content-type: text/html\r\n") != std::string::npos);
+    assert(get("/a.txt", "Range: bytes=5-2\r\n").second == text);
+    assert(get("/a.txt", "Range: items=0-1\r\n").second == text);
+    std::string many = "Range: bytes=0-0";
+    for(size_t i = 1; i <= HttpResponse::MAX_RANGES; i++) { many += "," + std::to_string(i) + "-" + std::to_string(i); }
+    assert(get("/a.txt", many + "\r\n").second == text);
+
+    //If-Range：校验值相同时按范围发送，否则发送整个文件
+    assert(get("/a.txt", "Range: bytes=0-0\r\nIf-Range: " + etag + "\r\n").second == "0");
+    assert(get("/a.txt", "Range: bytes=0-0\r\nIf-Range: " + modified + "\r\n").second == "0");
+    assert(get("/a.txt", "Range: bytes=0-0\r\nIf-Range: \"stale\"\r\n").second == text);
+
+    //sendfile的文件：从请求的位置开始发送
+    auto seek = get("/video.mp4", "Range: bytes=2000000-2000099\r\n");
+    assert(seek.first.find("HTTP/1.1 206") == 0 && seek.second == video.substr(2000000, 100));
+    auto tail = get("/video.mp4", "Range: bytes=1-2,-70000\r\n");
+    assert(tail.second.find(video.substr(1, 2)) != std::string::npos);
+    assert(tail.second.find(video.substr(video.size() - 70000)) != std::string::npos);
+    //其他方法忽略Range
+    std::string post = "POST /a.txt HTTP/1.1\r\nRange: bytes=0-0\r\nContent-Length: 0\r\n\r\n";
+    ssize_t n = ::write(fds[1], post.data(), post.size());
+    assert(n == static_cast<ssize_t>(post.size()));
+    int err = 0;
+    conn.read(&err);
+    conn.parse();
+    conn.MakeResponse();
+    std::string out;
+    SendAll(conn, fds[1], conn.ToWriteBytes(), &out);
+    assert(out.find("HTTP/1.1 200 OK") == 0 && out.compare(out.size() - text.size(), text.size(), text) == 0);
+
+    FileCache::Instance()->SetSendfileThreshold(FileCache::DEFAULT_SENDFILE_THRESHOLD);
+    conn.Close();
+    close(fds[1]);
+    unlink((srcDir + "a.txt").c_str());
+    unlink((srcDir + "video.mp4").c_str());
+    rmdir(dir);
+    printf("range ok\n");
+}
+
+//在socketpair上模拟服务器对一个连接的处理：读入、解析所有完整的请求、一次发送，返回对端收到的响应
+static std::string ServePipeline(HttpConn& conn, int peer, const std::string& requests) {
+    int err = 0;
+    ssize_t n = ::write(peer, requests.data(), requests.size());
+    assert(n == static_cast<ssize_t>(requests.size()));
+    conn.read(&err);
+    while(conn.CanPipeline() && conn.parse()) {
+        conn.MakeResponse();
+    }
+    conn.write(&err);
+    assert(conn.ToWriteBytes() == 0);
+    std::string out;
+    char buf[65536];
+    while((n = ::read(peer, buf, sizeof(buf))) > 0) {
+        out.append(buf, n);
+    }
+    return out;
+}
+
+//流水线深度1和16：同样的请求数，比较每个请求的耗时
+void TestPipeline() {
+    char dir[] = "/tmp/webserver_testXXXXXX";
+    assert(mkdtemp(dir));
+    std::string srcDir = std::string(dir) + "/";
+    {
+        std::ofstream page(srcDir + "index.html");
+        page << std::string(512, 'x');
+        std::ofstream error(srcDir + "404.html");
+        error << "not found";
+    }
+    HttpConn::srcDir = srcDir.c_str();
+    HttpConn::isET = true;
+
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(ret == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    HttpConn conn;
+    sockaddr_in addr = { 0 };
+    conn.init(fds[0], addr);
+
+    const std::string get = "GET /index.html HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n\r\n";
+    const std::string missing = "GET /missing HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    //16个请求，中间夹一个404和一个不完整的请求，响应按请求的顺序返回
+    std::string requests;
+    for(int i = 0; i < 15; i++) {
+        requests += i == 7 ? missing : get;
+    }
+    std::string single = ServePipeline(conn, fds[1], get);
+    assert(single.find("HTTP/1.1 200 OK") == 0 && single.size() > 512);
+    std::string out = ServePipeline(conn, fds[1], requests + get.substr(0, 20));
+    size_t pos = 0;
+    for(int i = 0; i < 15; i++) {
+        const char* expect = i == 7 ? "HTTP/1.1 404 Not Found" : "HTTP/1.1 200 OK";
+        assert(out.compare(pos, strlen(expect), expect) == 0);
+        pos = out.find("HTTP/1.1 ", pos + 1);
+    }
+    assert(pos == std::string::npos);
+    out = ServePipeline(conn, fds[1], get.substr(20));
+    assert(out == single);
+    assert(conn.IsKeepAlive());
+
+    const int n = 32000;
+    for(int depth: { 1, 16 }) {
+        std::string batch;
+        for(int i = 0; i < depth; i++) { batch += get; }
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n / depth; i++) {
+            out = ServePipeline(conn, fds[1], batch);
+            assert(out.size() == single.size() * depth);
+        }
+        std::chrono::duration<double, std::nano> cost = std::chrono::steady_clock::now() - start;
+        printf("pipeline depth %2d: %.0f ns/request\n", depth, cost.count() / n);
+    }
+    conn.Close();
+    close(fds[1]);
+    unlink((srcDir + "index.html").c_str());
+    unlink((srcDir + "404.html").c_str());
+    rmdir(dir);
+}
+
 int main() {
     TestLog();
     TestThreadPool();
+    TestThreadPoolBench();
+    TestThreadPoolElastic(ThreadPool::SHARED_QUEUE);
+    TestThreadPoolElastic(ThreadPool::WORK_STEALING);
+    TestTimeWheel();
+    TestTimerBench();
+    TestParseBench();
+    TestParseIncremental();
+    TestParseHeaders();
+    TestParseBody();
+    TestMultipart();
+    TestUrlEncoded();
+    TestHttpScan();
+    TestFileCache();
+    TestResponseCache();
+    TestPipeline();
+    TestSendfile();
+    TestRange();
 }
\ No newline at end of file